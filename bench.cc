@@ -0,0 +1,485 @@
+/**
+ * Copyright 2019 Ashar <ashar786khan@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief The kernel benchmark suite. Every operation of the library is timed
+ * for each element type, pair of layouts and size from a few elements to
+ * beyond the last level cache, and compared with the roofline of this
+ * machine: the bandwidth of a triad over all threads and the peak arithmetic
+ * rate of a multiply add loop over packets.
+ *
+ * Usage: bench [--quick] [--counters] [--filter text] [--json file]
+ *              [--csv file] [--compare baseline.json [--tolerance 0.1]]
+ *
+ * With --compare the results are checked against a baseline written by an
+ * earlier --json run. The exit status is 1 when a kernel got slower, see
+ * benchmark::compare, and 77 (skipped under CTest) when there is no
+ * baseline.
+ *
+ */
+
+#include "benchmark.hpp"
+#include "include/matrix.hpp"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using test::benchmark;
+using test::benchmark_options;
+using test::benchmark_result;
+using test::benchmark_work;
+
+/**
+ * @brief The peaks of the roofline in operations per second. The bandwidth
+ * roof is measured for the footprint of each kernel, see bandwidth.
+ *
+ */
+struct roofline {
+  double peak_int = 0, peak_long = 0, peak_float = 0, peak_double = 0;
+};
+
+/**
+ * @brief The real type underneath a possibly complex element type
+ *
+ */
+template <class T>
+struct real_of {
+  using type = T;
+};
+template <class T>
+struct real_of<std::complex<T>> {
+  using type = T;
+};
+
+template <class T>
+constexpr bool is_complex = !std::is_same<T, typename real_of<T>::type>::value;
+
+/**
+ * @brief The arithmetic operations of one addition and one multiplication of
+ * elements of type T
+ *
+ */
+template <class T>
+constexpr double add_ops = is_complex<T> ? 2 : 1;
+template <class T>
+constexpr double mul_ops = is_complex<T> ? 6 : 1;
+
+template <class T>
+char const *type_name() {
+  if (std::is_same<T, int>::value) return "int";
+  if (std::is_same<T, long long>::value) return "long";
+  if (std::is_same<T, float>::value) return "float";
+  if (std::is_same<T, double>::value) return "double";
+  if (std::is_same<T, std::complex<float>>::value) return "complex_float";
+  return "complex_double";
+}
+
+template <class F>
+char const *layout_name() {
+  return F::is_row_major ? "R" : "C";
+}
+
+/**
+ * @brief The size of the last level cache, 32 MB when it can not be read
+ *
+ */
+size_t last_level_cache() {
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+  long bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  if (bytes > 0) return static_cast<size_t>(bytes);
+#endif
+  return size_t(32) << 20;
+}
+
+/**
+ * @brief Runs f(first, last) over one range of [0, count) per thread of the
+ * library's executor, whatever the parallel threshold
+ *
+ */
+template <class F>
+void on_all_threads(size_t count, F const &f) {
+  test::executor &e = test::execution::current();
+  size_t parts = e.concurrency();
+  e.run(parts,
+        [&](size_t p) { f(count * p / parts, count * (p + 1) / parts); });
+}
+
+/**
+ * @brief Measures the peak rate of multiply adds on packets of T over all
+ * threads, in operations per second
+ *
+ */
+template <class T>
+double peak(benchmark_options const &options) {
+  using packet = test::simd::packet_t<T>;
+  constexpr size_t lanes = test::simd::packet_traits<T>::size;
+  constexpr size_t chains = 12, rounds = 4096;
+  size_t threads = test::execution::current().concurrency();
+  auto r = benchmark::run(
+      "peak", [&] {
+        on_all_threads(threads, [](size_t, size_t) {
+          packet acc[chains];
+          for (size_t c = 0; c < chains; c++) acc[c] = test::simd::set1(T(c));
+          packet m = test::simd::set1(T(1)), a = test::simd::set1(T(0));
+          for (size_t c = 0; c < chains; c++) test::do_not_optimize(acc[c]);
+          test::do_not_optimize(m);
+          test::do_not_optimize(a);
+          for (size_t i = 0; i < rounds; i++)
+            for (size_t c = 0; c < chains; c++) acc[c] = acc[c] * m + a;
+          for (size_t c = 0; c < chains; c++) test::do_not_optimize(acc[c]);
+        });
+      },
+      options, {0, 0, double(2 * lanes * chains * rounds * threads)});
+  return r.gflops() * 1e9;
+}
+
+/**
+ * @brief Measures the bandwidth of a triad whose three arrays span bytes in
+ * total, counting the two reads and the write. The loop is split among the
+ * threads like an elementwise assignment of the library, so that kernels
+ * fitting in a cache are compared with that cache's bandwidth.
+ *
+ */
+double bandwidth(size_t bytes, benchmark_options const &options) {
+  size_t n = std::max<size_t>(1, bytes / (3 * sizeof(double)));
+  std::vector<double> a(n, 1.0), b(n, 2.0), c(n, 3.0);
+  auto r = benchmark::run(
+      "triad", [&] {
+        test::execution::for_ranges(n, 3 * n, [&](size_t first, size_t last) {
+          for (size_t i = first; i < last; i++) a[i] = b[i] + 3.0 * c[i];
+        });
+        test::clobber_memory();
+      },
+      options, {0, double(3 * n * sizeof(double)), 0});
+  return r.gigabytes_per_second() * 1e9;
+}
+
+template <class T>
+double peak_of(roofline const &machine) {
+  using R = typename real_of<T>::type;
+  if (std::is_same<R, int>::value) return machine.peak_int;
+  if (std::is_same<R, long long>::value) return machine.peak_long;
+  if (std::is_same<R, float>::value) return machine.peak_float;
+  return machine.peak_double;
+}
+
+/**
+ * @brief The settings and results of one run of the suite
+ *
+ */
+struct suite {
+  benchmark_options options;
+  std::string filter;
+  std::vector<std::string> only;
+  std::vector<size_t> sizes;
+  size_t max_product = 1024;
+  roofline machine;
+  std::vector<std::pair<size_t, double>> bandwidths;
+  std::vector<benchmark_result> results;
+
+  /**
+   * @brief The triad bandwidth for a footprint of bytes, measured once
+   *
+   */
+  double bandwidth_for(size_t bytes) {
+    for (auto const &b : bandwidths)
+      if (b.first == bytes) return b.second;
+    benchmark_options triad = options;
+    triad.counters = false;
+    bandwidths.emplace_back(bytes, bandwidth(bytes, triad));
+    return bandwidths.back().second;
+  }
+
+  /**
+   * @brief Measures func unless its label is filtered out or missing from a
+   * non empty only, then prints the
+   * result against the roofline: memory bound when the operations per byte
+   * fall below the ridge point of the machine for this footprint, compute
+   * bound otherwise
+   *
+   */
+  template <class T, class F>
+  void measure(std::string const &label, F const &func,
+               benchmark_work const &work) {
+    if (label.find(filter) == std::string::npos) return;
+    if (!only.empty() &&
+        std::find(only.begin(), only.end(), label) == only.end())
+      return;
+    auto r = benchmark::run(label, func, options, work);
+    double ops = r.gflops() * 1e9, bytes = r.gigabytes_per_second() * 1e9;
+    double peak = peak_of<T>(machine);
+    char const *bound = "-";
+    double efficiency = 0;
+    if (work.bytes > 0) {
+      double memory = bandwidth_for(static_cast<size_t>(work.bytes));
+      double roof = std::min(peak, work.flops / work.bytes * memory);
+      bound = work.flops == 0 || roof < peak ? "memory" : "compute";
+      efficiency = work.flops == 0 ? bytes / memory : ops / roof;
+    }
+    std::printf("%-34s %14.0f %9.2f %9.2f %8s %7.1f%%", label.c_str(),
+                r.execution_time, r.gigabytes_per_second(), r.gflops(), bound,
+                100 * efficiency);
+    if (options.counters) {
+      using event = test::benchmark_counters;
+      auto cell = [](double value, int width) {
+        if (value < 0)
+          std::printf(" %*s", width, "-");
+        else
+          std::printf(" %*.4f", width, value);
+      };
+      cell(r.counters.ipc(), 6);
+      cell(r.per_element(event::l1_misses), 9);
+      cell(r.per_element(event::llc_misses), 9);
+      cell(r.per_element(event::dtlb_misses), 9);
+    }
+    std::printf("\n");
+    std::fflush(stdout);
+    results.push_back(std::move(r));
+  }
+};
+
+/**
+ * @brief Fills a matrix with small values that keep every operation exact
+ * and away from overflow and denormals
+ *
+ */
+template <class M>
+void fill(M &m, size_t seed) {
+  using T = typename M::value_type;
+  for (size_t i = 0; i < m.get_dimension().count(); i++)
+    m.get(i) = T(typename real_of<T>::type((i + seed) % 7 + 1));
+}
+
+/**
+ * @brief Benchmarks every operation on n x n matrices of T, with a and the
+ * output in layout F1 and b in layout F2. Operations of a single operand only
+ * run when both layouts agree.
+ *
+ */
+template <class T, class F1, class F2>
+void sweep(suite &s, size_t n) {
+  using M1 = test::matrix<T, F1>;
+  using M2 = test::matrix<T, F2>;
+  std::string tag = std::string("/") + type_name<T>() + "/" +
+                    layout_name<F1>() + layout_name<F2>() + "/" +
+                    std::to_string(n);
+  double count = double(n) * n, bytes = count * sizeof(T);
+  M1 a(n, n), c(n, n);
+  M2 b(n, n), same(n, n);
+  fill(a, 0);
+  fill(b, 3);
+  same = a;
+
+  s.measure<T>("chain" + tag, [&] { c = a * b + a - b; },
+               {count, 3 * bytes, count * (mul_ops<T> + 2 * add_ops<T>)});
+  s.measure<T>("equal" + tag, [&] { test::do_not_optimize(a == same); },
+               {count, 2 * bytes, 0});
+  if (n <= s.max_product)
+    s.measure<T>("product" + tag, [&] { c = a | b; },
+                 {count, 3 * bytes,
+                  count * n * (mul_ops<T> + add_ops<T>)});
+  if (F1::is_row_major != F2::is_row_major) return;
+
+  s.measure<T>("scalar" + tag, [&] { c = a * T(3) + T(1); },
+               {count, 2 * bytes, count * (mul_ops<T> + add_ops<T>)});
+  s.measure<T>("fill" + tag, [&] {
+    M1 m(n, n);
+    test::do_not_optimize(m.get(0));
+  }, {count, bytes, 0});
+  s.measure<T>("copy" + tag, [&] {
+    M1 m(a);
+    test::do_not_optimize(m.get(0));
+  }, {count, 2 * bytes, 0});
+  s.measure<T>("move" + tag, [&] {
+    M1 m(std::move(c));
+    c = std::move(m);
+    test::do_not_optimize(c.get(0));
+  }, {count, 0, 0});
+}
+
+/**
+ * @brief Sweeps the sizes and layouts for T. The largest size puts the three
+ * operands of an elementwise operation at twice the last level cache.
+ *
+ */
+template <class T>
+void sweep_type(suite &s) {
+  using R = test::policy::RowMajorPolicy<T>;
+  using C = test::policy::ColumnMajorPolicy<T>;
+  std::vector<size_t> sizes = s.sizes;
+  if (sizes.empty()) {
+    size_t big = static_cast<size_t>(
+        std::sqrt(2.0 * last_level_cache() / (3 * sizeof(T))));
+    sizes = {4, 64, 256, 1024, (big + 63) / 64 * 64};
+  }
+  for (size_t n : sizes) {
+    sweep<T, R, R>(s, n);
+    sweep<T, R, C>(s, n);
+    sweep<T, C, R>(s, n);
+    sweep<T, C, C>(s, n);
+  }
+}
+
+/**
+ * @brief Runs the whole suite
+ *
+ */
+void sweep_all(suite &s) {
+  sweep_type<int>(s);
+  sweep_type<long long>(s);
+  sweep_type<float>(s);
+  sweep_type<double>(s);
+  sweep_type<std::complex<float>>(s);
+  sweep_type<std::complex<double>>(s);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  suite s;
+  s.options.warmup_time = 0.01;
+  s.options.min_time = 0.01;
+  s.options.samples = 9;
+  s.options.max_time = 0.3;
+  std::string json, csv, compare;
+  double tolerance = 0.1;
+  for (int i = 1; i < argc; i++) {
+    bool more = i + 1 < argc;
+    if (std::strcmp(argv[i], "--quick") == 0) {
+      s.options.warmup_time = 0.002;
+      s.options.min_time = 0.005;
+      s.options.samples = 5;
+      s.options.max_time = 0.1;
+      s.sizes = {4, 256};
+    } else if (std::strcmp(argv[i], "--counters") == 0) {
+      s.options.counters = true;
+    } else if (std::strcmp(argv[i], "--filter") == 0 && more) {
+      s.filter = argv[++i];
+    } else if (std::strcmp(argv[i], "--json") == 0 && more) {
+      json = argv[++i];
+    } else if (std::strcmp(argv[i], "--csv") == 0 && more) {
+      csv = argv[++i];
+    } else if (std::strcmp(argv[i], "--compare") == 0 && more) {
+      compare = argv[++i];
+    } else if (std::strcmp(argv[i], "--tolerance") == 0 && more) {
+      tolerance = std::strtod(argv[++i], nullptr);
+    } else {
+      std::fprintf(stderr,
+                   "usage: %s [--quick] [--counters] [--filter text] "
+                   "[--json file] [--csv file] [--compare baseline.json "
+                   "[--tolerance 0.1]]\n",
+                   argv[0]);
+      return 2;
+    }
+  }
+
+  std::vector<benchmark_result> baseline;
+  if (!compare.empty()) {
+    std::ifstream in(compare);
+    if (!in) {
+      std::fprintf(stderr,
+                   "no baseline at %s, record one with --json %s or the "
+                   "perf-baseline target\n",
+                   compare.c_str(), compare.c_str());
+      return 77;
+    }
+    baseline = benchmark::read_json(in);
+  }
+
+  benchmark_options calibration = s.options;
+  calibration.samples = 5;
+  calibration.counters = false;
+  s.machine.peak_int = peak<int>(calibration);
+  s.machine.peak_long = peak<long long>(calibration);
+  s.machine.peak_float = peak<float>(calibration);
+  s.machine.peak_double = peak<double>(calibration);
+  std::printf("threads %zu, memory %.2f GB/s, peak GOP/s int %.2f long "
+              "%.2f float %.2f double %.2f\n\n",
+              test::execution::current().concurrency(),
+              s.bandwidth_for(4 * last_level_cache()) / 1e9,
+              s.machine.peak_int / 1e9, s.machine.peak_long / 1e9,
+              s.machine.peak_float / 1e9, s.machine.peak_double / 1e9);
+  std::printf("%-34s %14s %9s %9s %8s %8s", "kernel/type/layouts/n",
+              "median ns", "GB/s", "GOP/s", "bound", "roof");
+  if (s.options.counters) {
+    test::perf_counters probe;
+    if (!probe.error().empty())
+      std::fprintf(stderr, "not counted: %s\n", probe.error().c_str());
+    std::printf(" %6s %9s %9s %9s", "IPC", "L1/elem", "LLC/elem",
+                "dTLB/elem");
+  }
+  std::printf("\n");
+
+  sweep_all(s);
+
+  if (!json.empty()) {
+    std::ofstream out(json);
+    benchmark::write_json(out, s.results);
+    if (!out) {
+      std::fprintf(stderr, "cannot write %s\n", json.c_str());
+      return 2;
+    }
+  }
+  if (!csv.empty()) {
+    std::ofstream out(csv);
+    benchmark::write_csv(out, s.results);
+    if (!out) {
+      std::fprintf(stderr, "cannot write %s\n", csv.c_str());
+      return 2;
+    }
+  }
+  if (compare.empty()) return 0;
+
+  // Kernels found slower are measured again, twice at most, keeping their
+  // best median, so that a burst of noise on the machine does not fail the
+  // comparison.
+  std::vector<test::benchmark_change> changes;
+  size_t slower = 0;
+  for (int retry = 0; retry <= 2; retry++) {
+    changes = benchmark::compare(baseline, s.results, tolerance);
+    suite again = s;
+    again.results.clear();
+    again.only.clear();
+    for (auto const &c : changes)
+      if (c.result == test::benchmark_change::slower)
+        again.only.push_back(c.label);
+    slower = again.only.size();
+    if (slower == 0 || retry == 2) break;
+    std::printf("\nmeasuring %zu slower kernels again\n", slower);
+    sweep_all(again);
+    for (auto &r : again.results)
+      for (auto &old : s.results)
+        if (old.label == r.label && r.execution_time < old.execution_time)
+          old = r;
+  }
+  std::printf("\ncompared with %s, tolerance %.1f%%\n", compare.c_str(),
+              100 * tolerance);
+  benchmark::write_changes(std::cout, changes);
+  std::printf("%zu of %zu kernels slower\n", slower, changes.size());
+  return slower == 0 ? 0 : 1;
+}
@@ -17,47 +17,770 @@
 #ifndef BENCHMARK_HPP
 #define BENCHMARK_HPP
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <functional>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #ifndef BEAUTIFICATION_FACTOR
 #define BEAUTIFICATION_FACTOR (80)
 #endif
 
 namespace test {
+
+/**
+ * @brief Makes the compiler assume value is read, so that the computation
+ * producing it is not removed as dead code.
+ *
+ * @tparam T the type of the value
+ * @param value the value to keep
+ */
+template <class T>
+inline void do_not_optimize(T const &value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#else
+  static char const volatile *sink;
+  sink = reinterpret_cast<char const volatile *>(&value);
+#endif
+}
+
+/**
+ * @brief Makes the compiler assume value is read and modified, so that it can
+ * neither fold the value into the code using it nor drop its computation.
+ *
+ * @tparam T the type of the value
+ * @param value the value to keep
+ */
+template <class T>
+inline void do_not_optimize(T &value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : "+m"(value) : : "memory");
+#else
+  static char volatile *sink;
+  sink = reinterpret_cast<char volatile *>(&value);
+#endif
+}
+
+/**
+ * @brief Makes the compiler assume all memory is read and written here, so
+ * that stores before it are neither removed nor moved past it.
+ *
+ */
+inline void clobber_memory() {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : : "memory");
+#else
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+/**
+ * @brief How a benchmark is measured. The function is first run for
+ * warmup_time, then the number of iterations per sample is scaled until one
+ * sample lasts min_time, and samples are taken until there are samples of them
+ * or max_time has passed, whichever comes first. At least one sample is taken.
+ *
+ */
+struct benchmark_options {
+  double warmup_time = 0.1;
+  double min_time = 0.05;
+  size_t samples = 20;
+  double max_time = 5.0;
+  /**
+   * @brief true to read the hardware counters around the samples, see
+   * perf_counters. Defaults to MATRIX_BENCHMARK_COUNTERS being set.
+   *
+   */
+  bool counters = std::getenv("MATRIX_BENCHMARK_COUNTERS") != nullptr;
+};
+
+/**
+ * @brief Hardware events per iteration. An event that could not be counted
+ * is negative.
+ *
+ */
+struct benchmark_counters {
+  enum event {
+    cycles,
+    instructions,
+    l1_misses,
+    llc_misses,
+    dtlb_misses,
+    branch_misses,
+    page_faults,
+    events
+  };
+  std::array<double, events> values;
+
+  benchmark_counters() { values.fill(-1); }
+
+  bool available(event e) const { return values[e] >= 0; }
+  bool any() const {
+    for (double v : values)
+      if (v >= 0) return true;
+    return false;
+  }
+  double operator[](event e) const { return values[e]; }
+  /**
+   * @brief the instructions per cycle, negative unless both are counted
+   *
+   */
+  double ipc() const {
+    return available(cycles) && available(instructions) && values[cycles] > 0
+               ? values[instructions] / values[cycles]
+               : -1;
+  }
+  static char const *name(event e) {
+    static char const *const names[] = {
+        "cycles",      "instructions",  "l1_misses",  "llc_misses",
+        "dtlb_misses", "branch_misses", "page_faults"};
+    return names[e];
+  }
+};
+
+/**
+ * @brief Counts hardware events with perf_event_open on every thread of the
+ * process, the workers of a thread pool included, and on the threads they
+ * start. Events the kernel, the CPU or the permissions (perf_event_paranoid,
+ * containers) do not allow are left out and the reason is kept in error().
+ * Elsewhere than on Linux nothing is counted.
+ *
+ */
+class perf_counters {
+  std::vector<std::pair<benchmark_counters::event, int>> _fds;
+  std::string _error;
+
+#if defined(__linux__)
+  static std::vector<long> _threads() {
+    std::vector<long> tids;
+    if (DIR *dir = opendir("/proc/self/task")) {
+      while (dirent *entry = readdir(dir))
+        if (entry->d_name[0] != '.') tids.push_back(std::atol(entry->d_name));
+      closedir(dir);
+    }
+    if (tids.empty()) tids.push_back(0);
+    return tids;
+  }
+
+  static perf_event_attr _attr(benchmark_counters::event e) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    auto cache = [](uint64_t which, uint64_t op) {
+      return which | (op << 8) | (uint64_t(PERF_COUNT_HW_CACHE_RESULT_MISS)
+                                  << 16);
+    };
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (e) {
+      case benchmark_counters::cycles:
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+      case benchmark_counters::instructions:
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+      case benchmark_counters::l1_misses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config =
+            cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ);
+        break;
+      case benchmark_counters::llc_misses:
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+      case benchmark_counters::dtlb_misses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config =
+            cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ);
+        break;
+      case benchmark_counters::branch_misses:
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+      default:
+        attr.type = PERF_TYPE_SOFTWARE;
+        attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+        break;
+    }
+    return attr;
+  }
+
+  void _ioctl(unsigned long request) {
+    for (auto const &fd : _fds) ioctl(fd.second, request, 0);
+  }
+#endif
+
+ public:
+  /**
+   * @brief Opens the counters of every event on every current thread
+   *
+   */
+  perf_counters() {
+#if defined(__linux__)
+    std::vector<long> tids = _threads();
+    for (size_t e = 0; e < benchmark_counters::events; e++) {
+      auto event = static_cast<benchmark_counters::event>(e);
+      perf_event_attr attr = _attr(event);
+      for (long tid : tids) {
+        long fd = syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0);
+        if (fd >= 0) {
+          _fds.emplace_back(event, static_cast<int>(fd));
+        } else if (errno != ESRCH && _error.find(name(event)) ==
+                                         std::string::npos) {
+          _error += std::string(_error.empty() ? "" : ", ") + name(event) +
+                    ": " + std::strerror(errno);
+        }
+      }
+    }
+#else
+    _error = "performance counters need Linux";
+#endif
+  }
+  perf_counters(perf_counters const &) = delete;
+  perf_counters &operator=(perf_counters const &) = delete;
+  ~perf_counters() {
+#if defined(__linux__)
+    for (auto const &fd : _fds) close(fd.second);
+#endif
+  }
+
+  static char const *name(benchmark_counters::event e) {
+    return benchmark_counters::name(e);
+  }
+
+  /**
+   * @brief the events that could not be opened and why, empty when all were
+   *
+   */
+  std::string const &error() const { return _error; }
+
+  /**
+   * @brief Resets and starts the counters
+   *
+   */
+  void start() {
+#if defined(__linux__)
+    _ioctl(PERF_EVENT_IOC_RESET);
+    _ioctl(PERF_EVENT_IOC_ENABLE);
+#endif
+  }
+
+  /**
+   * @brief Stops the counters and reads them, scaled up for the time the
+   * kernel multiplexed them out
+   *
+   * @param iterations the iterations run since start
+   * @return benchmark_counters the events per iteration
+   */
+  benchmark_counters stop(double iterations) {
+    benchmark_counters result;
+#if defined(__linux__)
+    _ioctl(PERF_EVENT_IOC_DISABLE);
+    for (auto const &fd : _fds) {
+      uint64_t data[3] = {0, 0, 0};
+      if (read(fd.second, data, sizeof(data)) != sizeof(data)) continue;
+      double value = data[2] > 0 ? double(data[0]) * data[1] / data[2] : 0;
+      double &total = result.values[fd.first];
+      total = (total < 0 ? 0 : total) + value / iterations;
+    }
+#else
+    (void)iterations;
+#endif
+    return result;
+  }
+};
+
+/**
+ * @brief The work done by one iteration, from which the throughput is
+ * derived. Zero leaves the corresponding rate out.
+ *
+ */
+struct benchmark_work {
+  double elements = 0;
+  double bytes = 0;
+  double flops = 0;
+};
+
+/**
+ * @brief The statistics of a benchmark, in nanoseconds per iteration
+ *
+ */
 struct benchmark_result {
-  long long execution_time;
   std::string label;
-  benchmark_result() = delete;
-  benchmark_result(long long e, std::string &lbl)
-      : execution_time(e), label(lbl) {}
+  /**
+   * @brief the median time of an iteration in nanoseconds
+   *
+   */
+  double execution_time = 0;
+  double mean = 0, stddev = 0, min = 0, p95 = 0;
+  size_t iterations = 0;
+  std::vector<double> samples;
+  benchmark_work work;
+  /**
+   * @brief the hardware events per iteration, when options.counters is set
+   *
+   */
+  benchmark_counters counters;
+  /**
+   * @brief the events that could not be counted and why, see perf_counters
+   *
+   */
+  std::string counters_error;
+
+  benchmark_result() = default;
+  /**
+   * @brief Computes the statistics of samples
+   *
+   * @param lbl the name of the benchmark
+   * @param times the time of an iteration in each sample, in nanoseconds
+   * @param iters the iterations in each sample
+   * @param w the work of an iteration
+   */
+  benchmark_result(std::string lbl, std::vector<double> times, size_t iters,
+                   benchmark_work w = {})
+      : label(std::move(lbl)), iterations(iters), samples(std::move(times)),
+        work(w) {
+    if (samples.empty()) return;
+    std::vector<double> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+    execution_time = n % 2 ? sorted[n / 2]
+                           : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    size_t rank = static_cast<size_t>(std::ceil(0.95 * n));
+    p95 = sorted[std::min(n, rank) - 1];
+    min = sorted.front();
+    for (double t : sorted) mean += t;
+    mean /= n;
+    for (double t : sorted) stddev += (t - mean) * (t - mean);
+    stddev = n > 1 ? std::sqrt(stddev / (n - 1)) : 0;
+  }
+
+  /**
+   * @brief the elements processed per second at the median time
+   *
+   */
+  double elements_per_second() const {
+    return execution_time > 0 ? work.elements * 1e9 / execution_time : 0;
+  }
+  /**
+   * @brief the GB (10^9 bytes) moved per second at the median time
+   *
+   */
+  double gigabytes_per_second() const {
+    return execution_time > 0 ? work.bytes / execution_time : 0;
+  }
+  /**
+   * @brief the GFLOP executed per second at the median time
+   *
+   */
+  double gflops() const {
+    return execution_time > 0 ? work.flops / execution_time : 0;
+  }
+  /**
+   * @brief the count of event per element, negative when it was not counted
+   * or the elements are not known
+   *
+   */
+  double per_element(benchmark_counters::event e) const {
+    return counters.available(e) && work.elements > 0
+               ? counters[e] / work.elements
+               : -1;
+  }
 
-  void print_beautifully() {
+  void print_beautifully() const {
     for (int t = 0; t < BEAUTIFICATION_FACTOR; t++)
       std::cout << "*";
 
     std::cout << "\n"
-              << label << " executed for " << execution_time << " miliseconds ("
-              << execution_time / 1000.0 << " s) \n";
+              << label << ": median " << execution_time << " ns, p95 " << p95
+              << " ns, stddev " << stddev << " ns (" << samples.size()
+              << " samples of " << iterations << " iterations)\n";
+    if (work.elements > 0)
+      std::cout << elements_per_second() << " elements/s ";
+    if (work.bytes > 0) std::cout << gigabytes_per_second() << " GB/s ";
+    if (work.flops > 0) std::cout << gflops() << " GFLOP/s ";
+    if (work.elements > 0 || work.bytes > 0 || work.flops > 0)
+      std::cout << "\n";
+    if (counters.ipc() >= 0) std::cout << "IPC " << counters.ipc() << " ";
+    for (size_t e = benchmark_counters::l1_misses;
+         e < benchmark_counters::events; e++) {
+      auto event = static_cast<benchmark_counters::event>(e);
+      if (per_element(event) >= 0)
+        std::cout << benchmark_counters::name(event) << "/element "
+                  << per_element(event) << " ";
+    }
+    if (counters.any()) std::cout << "\n";
+    if (!counters_error.empty())
+      std::cout << "not counted: " << counters_error << "\n";
 
     for (int t = 0; t < BEAUTIFICATION_FACTOR; t++)
       std::cout << "*";
     std::cout << std::endl;
   }
+
+  /**
+   * @brief Writes the result as one JSON object
+   *
+   * @param out the stream to write to
+   */
+  void write_json(std::ostream &out) const {
+    std::streamsize precision = out.precision(10);
+    out << "{\"label\": \"";
+    for (char c : label) {
+      if (c == '"' || c == '\\')
+        out << '\\' << c;
+      else if (static_cast<unsigned char>(c) < 0x20) {
+        char escaped[8];
+        std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        out << escaped;
+      } else
+        out << c;
+    }
+    out << "\", \"median_ns\": " << execution_time << ", \"mean_ns\": " << mean
+        << ", \"stddev_ns\": " << stddev << ", \"min_ns\": " << min
+        << ", \"p95_ns\": " << p95 << ", \"samples\": " << samples.size()
+        << ", \"iterations\": " << iterations
+        << ", \"elements_per_second\": " << elements_per_second()
+        << ", \"gigabytes_per_second\": " << gigabytes_per_second()
+        << ", \"gflops\": " << gflops();
+    if (counters.ipc() >= 0) out << ", \"ipc\": " << counters.ipc();
+    for (size_t e = 0; e < benchmark_counters::events; e++) {
+      auto event = static_cast<benchmark_counters::event>(e);
+      if (counters.available(event))
+        out << ", \"" << benchmark_counters::name(event)
+            << "\": " << counters[event];
+    }
+    out << "}";
+    out.precision(precision);
+  }
+
+  /**
+   * @brief Writes the result as one CSV row, see csv_header
+   *
+   * @param out the stream to write to
+   */
+  void write_csv(std::ostream &out) const {
+    std::streamsize precision = out.precision(10);
+    out << '"';
+    for (char c : label) out << (c == '"' ? "\"\"" : std::string(1, c));
+    out << "\"," << execution_time << ',' << mean << ',' << stddev << ','
+        << min << ',' << p95 << ',' << samples.size() << ',' << iterations
+        << ',' << elements_per_second() << ',' << gigabytes_per_second() << ','
+        << gflops() << ',';
+    if (counters.ipc() >= 0) out << counters.ipc();
+    for (size_t e = 0; e < benchmark_counters::events; e++) {
+      auto event = static_cast<benchmark_counters::event>(e);
+      out << ',';
+      if (counters.available(event)) out << counters[event];
+    }
+    out << '\n';
+    out.precision(precision);
+  }
+
+  /**
+   * @brief the header of the rows written by write_csv
+   *
+   */
+  static char const *csv_header() {
+    return "label,median_ns,mean_ns,stddev_ns,min_ns,p95_ns,samples,"
+           "iterations,elements_per_second,gigabytes_per_second,gflops,ipc,"
+           "cycles,instructions,l1_misses,llc_misses,dtlb_misses,"
+           "branch_misses,page_faults\n";
+  }
+};
+
+/**
+ * @brief How the median of one benchmark moved from a baseline, see
+ * benchmark::compare
+ *
+ */
+struct benchmark_change {
+  enum verdict { same, faster, slower, added, removed };
+  std::string label;
+  double baseline = 0, current = 0;
+  verdict result = same;
+
+  /**
+   * @brief the relative change of the median, 0.1 for 10% slower
+   *
+   */
+  double change() const {
+    return baseline > 0 && current > 0 ? current / baseline - 1 : 0;
+  }
+  static char const *name(verdict v) {
+    static char const *const names[] = {"ok", "faster", "SLOWER", "new",
+                                        "missing"};
+    return names[v];
+  }
 };
 
 struct benchmark {
-  static auto run(std::string label, std::function<void()> func) {
-    auto start = std::chrono::high_resolution_clock::now();
-    func();
-    auto stop = std::chrono::high_resolution_clock::now();
-    return benchmark_result(
-        std::chrono::duration_cast<std::chrono::milliseconds>(stop - start)
-            .count(),
-        label);
+  /**
+   * @brief Measures func, see benchmark_options. Results the function
+   * computes should go through do_not_optimize, and writes to memory that
+   * nothing reads be followed by clobber_memory. With options.counters the
+   * hardware events of all samples are averaged into result.counters, events
+   * that can not be counted stay negative.
+   *
+   * @param label the name of the benchmark
+   * @param func the code to measure
+   * @param options how to measure it
+   * @param work the work of one call of func, for the throughput
+   * @return benchmark_result the statistics
+   */
+  static benchmark_result run(std::string label, std::function<void()> func,
+                              benchmark_options const &options = {},
+                              benchmark_work const &work = {}) {
+    using clock = std::chrono::steady_clock;
+    auto seconds = [](clock::duration d) {
+      return std::chrono::duration<double>(d).count();
+    };
+    auto batch = [&](size_t n) {
+      auto start = clock::now();
+      for (size_t i = 0; i < n; i++) func();
+      clobber_memory();
+      return seconds(clock::now() - start);
+    };
+
+    auto begin = clock::now();
+    size_t iterations = 1;
+    double elapsed = batch(iterations);
+    while (seconds(clock::now() - begin) < options.warmup_time ||
+           elapsed < options.min_time) {
+      if (elapsed < options.min_time) {
+        double scale = elapsed > 0 ? 1.2 * options.min_time / elapsed : 10;
+        iterations = static_cast<size_t>(
+            iterations * std::min(10.0, std::max(2.0, scale)));
+      }
+      if (seconds(clock::now() - begin) >= options.max_time) break;
+      elapsed = batch(iterations);
+    }
+
+    std::vector<double> times;
+    std::unique_ptr<perf_counters> counters;
+    if (options.counters) {
+      counters.reset(new perf_counters());
+      counters->start();
+    }
+    begin = clock::now();
+    do {
+      times.push_back(batch(iterations) * 1e9 / iterations);
+    } while (times.size() < options.samples &&
+             seconds(clock::now() - begin) < options.max_time);
+    size_t total = times.size() * iterations;
+    benchmark_result result(std::move(label), std::move(times), iterations,
+                            work);
+    if (counters) {
+      result.counters = counters->stop(double(total));
+      result.counters_error = counters->error();
+    }
+    return result;
+  }
+
+  /**
+   * @brief Writes results as a JSON array
+   *
+   * @param out the stream to write to
+   * @param results the results to write
+   */
+  static void write_json(std::ostream &out,
+                         std::vector<benchmark_result> const &results) {
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); i++) {
+      out << "  ";
+      results[i].write_json(out);
+      out << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+  }
+
+  /**
+   * @brief Reads results written by write_json. The statistics, iterations
+   * and counters are restored, the samples themselves are not saved.
+   *
+   * @param in the stream to read from
+   * @return std::vector<benchmark_result> the results in file order
+   */
+  static std::vector<benchmark_result> read_json(std::istream &in) {
+    std::string text((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    std::vector<benchmark_result> results;
+    size_t at = 0;
+    auto fail = [] {
+      throw std::logic_error("Malformed benchmark results, expected the "
+                             "JSON written by benchmark::write_json");
+    };
+    auto skip = [&] {
+      while (at < text.size() &&
+             std::isspace(static_cast<unsigned char>(text[at])))
+        at++;
+      if (at == text.size()) fail();
+    };
+    auto quoted = [&] {
+      std::string value;
+      if (text[at++] != '"') fail();
+      while (at < text.size() && text[at] != '"') {
+        char c = text[at++];
+        if (c == '\\' && at < text.size()) {
+          c = text[at++];
+          if (c == 'u' && at + 4 <= text.size()) {
+            c = static_cast<char>(
+                std::strtol(text.substr(at, 4).c_str(), nullptr, 16));
+            at += 4;
+          }
+        }
+        value += c;
+      }
+      if (at++ == text.size()) fail();
+      return value;
+    };
+    while ((at = text.find('{', at)) != std::string::npos) {
+      at++;
+      benchmark_result r;
+      for (skip(); text[at] != '}'; skip()) {
+        if (text[at] == ',') {
+          at++;
+          continue;
+        }
+        std::string key = quoted();
+        skip();
+        if (text[at++] != ':') fail();
+        skip();
+        if (text[at] == '"') {
+          std::string value = quoted();
+          if (key == "label") r.label = value;
+          continue;
+        }
+        char *end = nullptr;
+        double value = std::strtod(text.c_str() + at, &end);
+        if (end == text.c_str() + at) fail();
+        at = static_cast<size_t>(end - text.c_str());
+        if (key == "median_ns") r.execution_time = value;
+        if (key == "mean_ns") r.mean = value;
+        if (key == "stddev_ns") r.stddev = value;
+        if (key == "min_ns") r.min = value;
+        if (key == "p95_ns") r.p95 = value;
+        if (key == "iterations") r.iterations = static_cast<size_t>(value);
+        for (size_t e = 0; e < benchmark_counters::events; e++)
+          if (key == benchmark_counters::name(
+                         static_cast<benchmark_counters::event>(e)))
+            r.counters.values[e] = value;
+      }
+      at++;
+      results.push_back(std::move(r));
+    }
+    return results;
+  }
+
+  /**
+   * @brief Compares the medians of current with those of baseline, matched
+   * by label. A benchmark is slower when its median grew by more than
+   * tolerance and by more than three standard errors of the difference of the
+   * medians, estimated from both standard deviations and the samples of the
+   * current run. Faster is symmetric.
+   *
+   * @param baseline the reference results, e.g. from read_json
+   * @param current the results to check
+   * @param tolerance the relative change allowed, 0.1 for 10%
+   * @return std::vector<benchmark_change> one change per label of either
+   */
+  static std::vector<benchmark_change> compare(
+      std::vector<benchmark_result> const &baseline,
+      std::vector<benchmark_result> const &current, double tolerance) {
+    std::vector<benchmark_change> changes;
+    for (auto const &c : current) {
+      benchmark_change change;
+      change.label = c.label;
+      change.current = c.execution_time;
+      change.result = benchmark_change::added;
+      for (auto const &b : baseline) {
+        if (b.label != c.label) continue;
+        change.baseline = b.execution_time;
+        double n = double(std::max<size_t>(1, c.samples.size()));
+        double error =
+            1.2533 * std::sqrt((b.stddev * b.stddev + c.stddev * c.stddev) / n);
+        double delta = c.execution_time - b.execution_time;
+        change.result = benchmark_change::same;
+        if (std::abs(delta) > 3 * error &&
+            std::abs(delta) > tolerance * b.execution_time)
+          change.result =
+              delta > 0 ? benchmark_change::slower : benchmark_change::faster;
+        break;
+      }
+      changes.push_back(change);
+    }
+    for (auto const &b : baseline) {
+      bool found = false;
+      for (auto const &c : current) found = found || c.label == b.label;
+      if (found) continue;
+      benchmark_change change;
+      change.label = b.label;
+      change.baseline = b.execution_time;
+      change.result = benchmark_change::removed;
+      changes.push_back(change);
+    }
+    return changes;
+  }
+
+  /**
+   * @brief Writes the changes as a table, one benchmark per line
+   *
+   * @param out the stream to write to
+   * @param changes the changes to write
+   */
+  static void write_changes(std::ostream &out,
+                            std::vector<benchmark_change> const &changes) {
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-40s %14s %14s %8s  %s\n", "benchmark",
+                  "baseline ns", "current ns", "change", "verdict");
+    out << line;
+    for (auto const &c : changes) {
+      std::snprintf(line, sizeof(line), "%-40s %14.0f %14.0f %+7.1f%%  %s\n",
+                    c.label.c_str(), c.baseline, c.current, 100 * c.change(),
+                    benchmark_change::name(c.result));
+      out << line;
+    }
+  }
+
+  /**
+   * @brief Writes results as CSV with a header row
+   *
+   * @param out the stream to write to
+   * @param results the results to write
+   */
+  static void write_csv(std::ostream &out,
+                        std::vector<benchmark_result> const &results) {
+    out << benchmark_result::csv_header();
+    for (auto const &r : results) r.write_csv(out);
   }
 };
 
-} // namespace boost::test
+}  // namespace test
 #endif
@@ -39,19 +39,47 @@
 #ifndef MATRIX_HPP
 #define MATRIX_HPP
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <complex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
 #include <initializer_list>
+#include <iterator>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
-#if defined(_OPENMP)
-#include <omp.h>
-#else
-#pragma GCC warning \
-    "OPENMP is not defined. Please compile with -fopenmp to get parallel for loops"
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MATRIX_HAS_MMAP 1
+#endif
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
 #endif
 
 /**
@@ -83,14 +111,14 @@ struct dimension {
    * @brief Construct a new dimension object
    *
    */
-  dimension() = default;
+  constexpr dimension() = default;
   /**
    * @brief Construct a new dimension object
    *
    * @param r The row of the matrix
    * @param c The column of the matrix
    */
-  dimension(size_t r, size_t c) : row_dimen(r), col_dimen(c) {}
+  constexpr dimension(size_t r, size_t c) : row_dimen(r), col_dimen(c) {}
   /**
    * @brief Overload for the comparting of the two dimension object
    *
@@ -121,963 +149,6195 @@ struct dimension {
    *
    * @return size_t the value it can hold
    */
-  size_t count() const { return row_dimen * col_dimen; }
+  constexpr size_t count() const { return row_dimen * col_dimen; }
 };
 
+template <typename E>
+class expression;
+
+namespace storage {
 /**
- * @brief An unnamed namespace we want for current file only.
+ * @brief Access hints for storage that pages its elements in on demand, see
+ * storage::mapped
  *
  */
-namespace {
+enum class advice {
+  /**
+   * @brief the range is read soon, start paging it in
+   *
+   */
+  will_need,
+  /**
+   * @brief the range is not read again, its memory may be reclaimed
+   *
+   */
+  done
+};
+}  // namespace storage
+
 /**
- * @brief Some internal utility functions
+ * @brief The interface of the thread pools the parallel loops of the library
+ * run on. Implement it to run them on the task system of an application, see
+ * execution::use.
  *
  */
-struct util {
+class executor {
+ public:
+  virtual ~executor() = default;
   /**
-   * @brief Converts the indexes from one to other format if necessary
+   * @brief The number of threads that run tasks, the calling one included
    *
-   * @tparam E1 the template paramater for the first type
-   * @tparam E2 the template parameter for the second type
-   * @param expr1 the first expression
-   * @param expr2 the second expression
-   * @param target the target index to convert. Index corresponsing to expr1's
-   * format
-   * @return size_t the index that will work in expr2's format.
+   * @return size_t the number of threads
    */
-  template <class E1, class E2>
-  static size_t safe_index(E1 const &expr1, E2 const &expr2, size_t target) {
-    if (std::is_same<decltype(expr1.get_format()),
-                     decltype(expr2.get_format())>::value)
-      return target;
-    else
-      return decltype(expr1.get_format())::to_other_major(
-          target, expr1.get_dimension());
-  }
+  virtual size_t concurrency() const = 0;
   /**
-   * @brief Checks if two arguments have same dimension
+   * @brief Runs body(t) for every t in [0, tasks), in any order and on any
+   * thread, and returns once all of them have finished. body may call run
+   * again, and run may be called from several threads at once.
    *
-   * @tparam A the type of first argument
-   * @tparam B the type of second argument
-   * @param a the first argument
-   * @param b the second argument
+   * @param tasks the number of tasks
+   * @param body the task
    */
-  template <class A, class B>
-  static void assert_same_dimensions(A const &a, B const &b) {
-    if (a.get_dimension() != b.get_dimension())
-      throw std::logic_error(
-          std::string(
-              "Dimension assertion failed. Required same dimensions found ") +
-          a.get_dimension().to_string() + std::string(" and ") +
-          b.get_dimension().to_string());
+  virtual void run(size_t tasks, std::function<void(size_t)> const &body) = 0;
+  /**
+   * @brief Like run, but task t runs on the same thread in every call with
+   * the same number of tasks when the executor can guarantee it. Memory first
+   * touched by a task then stays local to the thread reading it later, see
+   * storage::first_touch_allocator. By default it is run.
+   *
+   * @param tasks the number of tasks
+   * @param body the task
+   */
+  virtual void run_pinned(size_t tasks,
+                          std::function<void(size_t)> const &body) {
+    run(tasks, body);
   }
 };
-}  // namespace
 
-namespace policy {
+/**
+ * @brief An executor that runs every task on the calling thread, for callers
+ * that are already parallel
+ *
+ */
+class inline_executor final : public executor {
+ public:
+  size_t concurrency() const override { return 1; }
+  void run(size_t tasks, std::function<void(size_t)> const &body) override {
+    for (size_t t = 0; t < tasks; t++) body(t);
+  }
+};
 
 /**
- * @brief Policy that specifies the Row Major Ordering to follow
+ * @brief The default executor. Each worker thread owns a queue of task
+ * ranges. run splits its tasks into one range per queue and waits by running
+ * its own tasks. A worker takes tasks from the front of its own queue and,
+ * once that is empty, steals from the back of the others. A thread waiting in
+ * run only runs tasks of its own call, so nested calls can neither deadlock
+ * nor interleave unrelated work on the waiting stack.
  *
- * @tparam value_t the datatype of the matrix
  */
-template <class value_t>
-struct RowMajorPolicy {
+class work_stealing_pool final : public executor {
+  struct job {
+    std::function<void(size_t)> const *body;
+    std::atomic<size_t> remaining;
+    std::mutex failure_lock;
+    std::exception_ptr failure;
+  };
+  struct range {
+    job *owner;
+    size_t begin, end;
+    bool pinned;
+  };
+  struct queue {
+    std::mutex lock;
+    std::deque<range> ranges;
+    std::atomic<size_t> pinned{0};
+  };
+
+  std::vector<queue> _queues;
+  std::vector<std::thread> _threads;
+  std::mutex _sleep;
+  std::condition_variable _wake;
+  std::atomic<size_t> _queued{0};
+  bool _stop = false;
+
   /**
-   * @brief Actual Implementation of the ordering
+   * @brief the pool and worker index of the calling thread
    *
-   * @param bucket the flattened matrix representation vector.
-   * @param indexX the row index that is requested
-   * @param indexY the column index that is requested
-   * @param dimen the dimension of the matrix
-   * @return value_t& the reference to the element being selected by this
-   * policy.
    */
-  static auto &ordering(std::vector<value_t> &bucket, size_t indexX,
-                        size_t indexY, dimension dimen) {
-    return bucket[(indexX * (dimen.col_dimen)) + (indexY)];
+  struct _identity {
+    work_stealing_pool const *pool = nullptr;
+    size_t index = 0;
+  };
+  static _identity &_self() {
+    thread_local _identity self;
+    return self;
   }
-  /**if(std::is_same<_u.get_format(), _v.get_format()>::value) return
-   * @brief Actual Implementation of the ordering
+
+  /**
+   * @brief Claims one task of job only, or of any job when only is null, from
+   * queue q: the first task of the first range from the front when q is the
+   * caller's, the last task of the last range from the back otherwise.
    *
-   * @param bucket the flattened matrix representation vector.
-   * @param indexX the row index that is requested
-   * @param indexY the column index that is requested
-   * @param dimen the dimension of the matrix
-   * @return value_t& the reference to the element being selected by this
-   * policy.
    */
-  static auto ordering(std::vector<value_t> const &bucket, size_t indexX,
-                       size_t indexY, dimension dimen) {
-    return bucket[(indexX * (dimen.col_dimen)) + (indexY)];
+  bool _claim(size_t q, job const *only, bool own, job *&owner,
+              size_t &task) {
+    std::lock_guard<std::mutex> guard(_queues[q].lock);
+    auto &ranges = _queues[q].ranges;
+    for (size_t n = 0; n < ranges.size(); n++) {
+      size_t at = own ? n : ranges.size() - 1 - n;
+      range &r = ranges[at];
+      if ((only != nullptr && r.owner != only) || (r.pinned && !own)) continue;
+      owner = r.owner;
+      task = own ? r.begin++ : --r.end;
+      if (r.pinned)
+        _queues[q].pinned.fetch_sub(1);
+      else
+        _queued.fetch_sub(1);
+      if (r.begin == r.end) ranges.erase(ranges.begin() + at);
+      return true;
+    }
+    return false;
   }
+
   /**
-   * @brief Fills the bucket of flattened array using Row major Ordering
+   * @brief Runs one task of job only, or of any job, from the queue of worker
+   * self or stolen from another one.
    *
-   * @param bucket the flattened bucket to fill the elements to.
-   * @param elems the elements in the form of vector of vectors.
+   * @return true if a task was run
    */
-  static void fill(std::vector<value_t> &bucket,
-                   std::vector<std::vector<value_t>> const &elems) {
-    size_t counter = 0;
-    for (auto &e : elems)
-      for (auto &E : e) bucket[counter++] = E;
+  bool _run_one(size_t self, job const *only) {
+    job *owner = nullptr;
+    size_t task = 0;
+    size_t queues = _queues.size();
+    bool found = self < queues && _claim(self, only, true, owner, task);
+    thread_local size_t victim = 0;
+    for (size_t n = 0; !found && n < queues; n++)
+      found = _claim(victim++ % queues, only, false, owner, task);
+    if (found) _execute(*owner, task);
+    return found;
   }
+
   /**
-   * @brief Converts the given index to its equivalent column major index.
+   * @brief Runs task of owner and records its exception, if any
    *
-   * @param i the index whose equivalent is desired
-   * @param dimen the dimension of the matrix
-   * @return size_t return a value in range [0, row*columns)
    */
-
-  static size_t to_other_major(size_t const &i, dimension const &dimen) {
-    size_t x = i / dimen.col_dimen;
-    size_t y = i % dimen.col_dimen;
-    return (y * dimen.row_dimen + x);
+  static void _execute(job &owner, size_t task) {
+    try {
+      (*owner.body)(task);
+    } catch (...) {
+      std::lock_guard<std::mutex> guard(owner.failure_lock);
+      if (!owner.failure) owner.failure = std::current_exception();
+    }
+    owner.remaining.fetch_sub(1);
   }
-};
 
-/**
- * @brief Policy that specifies the Column Major Ordering to follow
- *
- * @tparam value_t the datatype of the matrix
- */
-template <class value_t>
-struct ColumnMajorPolicy {
   /**
-   * @brief Actual Implementation of the ordering
+   * @brief Wakes the workers to look at their queues
    *
-   * @param bucket the flattened matrix representation vector.
-   * @param indexX the row index that is requested
-   * @param indexY the column index that is requested
-   * @param dimen the dimension of the matrix
-   * @return value_t& the reference to the element being selected by this
-   * policy.
    */
-  static auto &ordering(std::vector<value_t> &bucket, size_t indexX,
-                        size_t indexY, dimension dimen) {
-    return bucket[(indexY * (dimen.row_dimen)) + (indexX)];
+  void _notify() {
+    {
+      std::lock_guard<std::mutex> guard(_sleep);
+    }
+    _wake.notify_all();
   }
+
   /**
-   * @brief Actual Implementation of the ordering
+   * @brief Runs tasks of work from the calling thread self until all of them
+   * have finished
    *
-   * @param bucket the flattened matrix representation vector.
-   * @param indexX the row index that is requested
-   * @param indexY the column index that is requested
-   * @param dimen the dimension of the matrix
-   * @return value_t& the reference to the element being selected by this
-   * policy.
    */
-  static auto ordering(std::vector<value_t> const &bucket, size_t indexX,
-                       size_t indexY, dimension dimen) {
-    return bucket[(indexY * (dimen.row_dimen)) + (indexX)];
+  void _finish(job &work, size_t self) {
+    while (work.remaining.load() != 0)
+      if (!_run_one(self, &work)) std::this_thread::yield();
+    if (work.failure) std::rethrow_exception(work.failure);
   }
 
   /**
-   * @brief Fills the bucket of flattened array using Column major Ordering
+   * @brief Pins worker index to one logical CPU, the callers keep the CPU
+   * the scheduler gives them
    *
-   * @param bucket the flattened bucket to fill the elements to.
-   * @param elems the elements in the form of vector of vectors.
    */
-  static void fill(std::vector<value_t> &bucket,
-                   std::vector<std::vector<value_t>> const &elems) {
-    size_t counter = 0;
-    auto row_counts = elems.size();
-    auto col_counts = elems[0].size();
-#pragma omp parallel for
-    for (size_t a = 0; a < col_counts; a++)
-#pragma omp parallel for
-      for (size_t b = 0; b < row_counts; b++) bucket[counter++] = elems[b][a];
+  static void _pin(std::thread &worker, size_t index) {
+#if defined(__linux__)
+    size_t cpus = std::thread::hardware_concurrency();
+    if (cpus < 2) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET((index + 1) % cpus, &set);
+    pthread_setaffinity_np(worker.native_handle(), sizeof(set), &set);
+#else
+    (void)worker;
+    (void)index;
+#endif
   }
+
   /**
-   * @brief Converts the given index to its equivalent row major index.
+   * @brief The loop of worker index
    *
-   * @param i the index whose equivalent is desired
-   * @param dimen the dimension of the matrix
-   * @return size_t return a value in range [0, row*columns)
    */
-
-  static size_t to_other_major(size_t const &i, dimension const &dimen) {
-    size_t y = i / dimen.row_dimen;
-    size_t x = i % dimen.row_dimen;
-    return (x * dimen.col_dimen + y);
+  void _work(size_t index) {
+    _self() = {this, index};
+    while (true) {
+      if (_run_one(index, nullptr)) continue;
+      std::unique_lock<std::mutex> lock(_sleep);
+      _wake.wait(lock, [&] {
+        return _stop || _queued.load() > 0 ||
+               _queues[index].pinned.load() > 0;
+      });
+      if (_stop) return;
+    }
   }
-};
-}  // namespace policy
 
-/**
- * @brief An template Expression class for a node in AST of lazy evalution.
- *
- * @tparam E the type to create an expression into.
- */
-template <typename E>
-class expression {
  public:
   /**
-   * @brief returns the expression at i
+   * @brief Construct a new pool that runs tasks on threads threads, the
+   * calling one included
    *
-   * @param i the index
-   * @return expression<E> the expression at that index.
+   * @param threads the concurrency of the pool, at least one
+   * @param pin true to pin each worker to its own logical CPU, so that the
+   * memory it first touches stays on its NUMA node
    */
-  auto get(size_t i) const {
-    return static_cast<E const &>(*this).get(i);  // East-Const
+  explicit work_stealing_pool(size_t threads, bool pin = false)
+      : _queues(threads > 1 ? threads - 1 : 0) {
+    for (size_t i = 0; i < _queues.size(); i++) {
+      _threads.emplace_back([this, i] { _work(i); });
+      if (pin) _pin(_threads.back(), i);
+    }
   }
-  /**
-   * @brief Get the dimension of expression object
-   *
-   * @return dimension the dimension of the expression.
-   */
-  auto get_dimension() const {
-    return static_cast<E const &>(*this).get_dimension();
+  work_stealing_pool(work_stealing_pool const &) = delete;
+  work_stealing_pool &operator=(work_stealing_pool const &) = delete;
+  ~work_stealing_pool() override {
+    {
+      std::lock_guard<std::mutex> guard(_sleep);
+      _stop = true;
+    }
+    _wake.notify_all();
+    for (auto &t : _threads) t.join();
+  }
+
+  size_t concurrency() const override { return _threads.size() + 1; }
+
+  void run(size_t tasks, std::function<void(size_t)> const &body) override {
+    if (tasks == 0) return;
+    if (tasks == 1 || _threads.empty()) {
+      for (size_t t = 0; t < tasks; t++) body(t);
+      return;
+    }
+    job work;
+    work.body = &body;
+    work.remaining = tasks;
+    size_t queues = _queues.size();
+    size_t self = _self().pool == this ? _self().index : queues;
+    size_t parts = tasks < queues ? tasks : queues;
+    _queued.fetch_add(tasks);
+    for (size_t p = 0; p < parts; p++) {
+      size_t q = self < queues ? (self + p) % queues : p;
+      std::lock_guard<std::mutex> guard(_queues[q].lock);
+      _queues[q].ranges.push_back(
+          {&work, tasks * p / parts, tasks * (p + 1) / parts, false});
+    }
+    _notify();
+    _finish(work, self);
   }
 
   /**
-   * @brief Get the format object
+   * @brief Runs task t on worker t % concurrency(), or on the calling thread
+   * when that is concurrency() - 1. Pinned tasks are never stolen. Called
+   * from a worker of this pool, all tasks run on that worker: the others may
+   * be waiting for jobs that only it can finish.
    *
-   * @return the type of the format used in this matrix
+   * @param tasks the number of tasks
+   * @param body the task
    */
-
-  auto get_format() const { return static_cast<E const &>(*this).get_format(); }
+  void run_pinned(size_t tasks,
+                  std::function<void(size_t)> const &body) override {
+    if (tasks == 0) return;
+    if (_threads.empty() || _self().pool == this) {
+      for (size_t t = 0; t < tasks; t++) body(t);
+      return;
+    }
+    job work;
+    work.body = &body;
+    work.remaining = tasks;
+    size_t queues = _queues.size();
+    for (size_t t = 0; t < tasks; t++) {
+      size_t q = t % (queues + 1);
+      if (q == queues) continue;
+      std::lock_guard<std::mutex> guard(_queues[q].lock);
+      _queues[q].ranges.push_back({&work, t, t + 1, true});
+      _queues[q].pinned.fetch_add(1);
+    }
+    _notify();
+    for (size_t t = queues; t < tasks; t += queues + 1) _execute(work, t);
+    _finish(work, queues);
+  }
 };
 
 /**
+ * @brief The execution policy shared by every loop of the library. A loop
+ * runs on the calling thread unless its work, the number of elements times
+ * the cost of an element, reaches parallel_threshold(); vectorization is
+ * picked independently from the packet traits of the expression. Parallel
+ * loops run as tasks, one per tile or range, on the current executor. The
+ * threshold comes from the MATRIX_PARALLEL_THRESHOLD environment variable,
+ * else from the calibration file, else from a calibration run. Its result is
+ * written to the calibration file for the next process only when
+ * MATRIX_CALIBRATION_FILE names one, otherwise it lives in memory.
  *
- * @brief The template class of the matrix. It is final and implements
- * Curiously Recurring Templates Pattern. These matrices have immutable
- * dimension and shapes will not change once created.
- *
- * @tparam value_t the type that this matrix will hold.
  */
-template <typename value_t, class format_t = policy::RowMajorPolicy<value_t>,
-          class storage_t = std::vector<value_t>>
-class matrix final : public expression<matrix<value_t, format_t, storage_t>> {
-  dimension const _dimen;
-  storage_t _elements;
-  format_t _format;
-
+struct execution {
   /**
-   * @brief Constructs the values in the container. If it is
+   * @brief The work stealing pool used unless another executor is injected.
+   * It runs on MATRIX_NUM_THREADS threads when set, else on one per core, and
+   * pins its workers to cores when MATRIX_PIN_THREADS is set and not 0.
    *
+   * @return work_stealing_pool& the pool
    */
-  void _construct_container() {
-    if (std::is_same<std::vector<value_t>, storage_t>::value) {
-      _elements = std::move(std::vector<value_t>(_dimen.count()));
-      // @todo(coder3101) : Make dimension non-constant as it can change because
-      // container is vector.
-    } else {
-      if (_dimen.count() != _elements.size()) {
-        throw std::logic_error(
-            std::string("Cannot Create a matrix out of provided array size. "
-                        "Array size must be ") +
-            std::to_string(_dimen.count()));
-      }
-    }
+  static work_stealing_pool &default_pool() {
+    static work_stealing_pool pool(
+        [] {
+          char const *value = std::getenv("MATRIX_NUM_THREADS");
+          size_t threads = value ? std::strtoull(value, nullptr, 10)
+                                 : std::thread::hardware_concurrency();
+          return threads == 0 ? size_t(1) : threads;
+        }(),
+        [] {
+          char const *value = std::getenv("MATRIX_PIN_THREADS");
+          return value != nullptr && std::strcmp(value, "0") != 0;
+        }());
+    return pool;
   }
 
   /**
-   * @brief This functions returns the index in such a way that regardless of
-   * the format. We always assign correct values to indices.
+   * @brief The executor running the parallel loops
    *
-   * @tparam E the expr or the matrix type
-   * @param expr the expression or matrix object
-   * @param index the index of to read
-   * @return size_t the index in the other format if they differ.
+   * @return executor& the current executor
    */
-  template <class E>
-  size_t _safe_index(E &expr, size_t index) const {
-    return util::safe_index(*this, expr, index);
+  static executor &current() {
+    executor *e = _current().load();
+    return e != nullptr ? *e : default_pool();
   }
 
   /**
-   * @brief This is an implentation that will copy the expr to the matrix.
-   * Even if they are of different order format. If the two formats are same
-   * then we simply copy the internal representation of the expr to this. Else
-   * we will assign the values by converting indices so that correct elements
-   * are assigned or acessed. This causes the implementation to slow down as
-   * compared to former as we try to non-sequencially access the expr internal
-   * representation.
+   * @brief Runs the parallel loops on e from now on, which must outlive its
+   * use. nullptr restores the default pool.
    *
-   * @tparam E the expression/matrix template
-   * @param expr the actual expression
-   * @param i the index to copy.
+   * @param e the executor to use
    */
+  static void use(executor *e) { _current().store(e); }
 
-  template <typename E>
-  void _safe_copy(E &expr, size_t i) {
-    this->_elements[i] = expr.get(_safe_index(expr, i));
-  }
   /**
-   * @brief Swaps the elements from the given expression
+   * @brief Runs f(t) for every t in [0, tasks): as tasks of the current
+   * executor when work reaches the threshold, else in order on the calling
+   * thread.
    *
-   * @tparam E the expression template
-   * @param expr the actual expression
-   * @param i the index of swap
+   * @tparam F the type of the task
+   * @param tasks the number of tasks
+   * @param work the work of the whole loop, see parallel
+   * @param f the task
    */
-
-  template <typename E>
-  void _safe_move(E &&expr, size_t i) {
-    this->_elements[i] = std::move(expr.get(_safe_index(expr, i)));
+  template <class F>
+  static void for_each(size_t tasks, size_t work, F const &f) {
+    if (tasks > 1 && parallel(work)) {
+      executor &e = current();
+      if (e.concurrency() > 1) {
+        e.run(tasks, std::function<void(size_t)>(std::cref(f)));
+        return;
+      }
+    }
+    for (size_t t = 0; t < tasks; t++) f(t);
   }
 
- public:
   /**
-   * @brief returns element at i, j position in the matrix.
+   * @brief The length of the ranges a loop over count elements is split into,
+   * a multiple of align. A serial loop is a single range, a parallel one
+   * gives a few ranges to each thread so that stealing can balance them.
    *
-   * @param i the row index
-   * @param j the column index
-   * @return dtype the element at that position
+   * @param count the elements in the loop
+   * @param work the work of the whole loop, see parallel
+   * @param align the granularity of the ranges, e.g. a packet
+   * @return size_t the length of a range, at least 1
    */
-  auto get(size_t i, size_t j) const {
-    return format_t::ordering(_elements, i, j, _dimen);
+  static size_t grain(size_t count, size_t work, size_t align = 1) {
+    size_t ranges = parallel(work) ? 4 * current().concurrency() : 1;
+    size_t length = (count + ranges - 1) / ranges;
+    length = (length + align - 1) / align * align;
+    return length == 0 ? align : length;
   }
+
   /**
-   * @brief returns element at i, j position in the matrix by reference. It can
-   * be used to assign values to i,j as well.
+   * @brief Runs f(first, last) over consecutive ranges covering [0, count),
+   * see grain and for_each.
    *
-   * @param i the row index
-   * @param j the column index
-   * @return dtype the element at that position
+   * @tparam F the type of the task
+   * @param count the elements in the loop
+   * @param work the work of the whole loop, see parallel
+   * @param f the task
+   * @param align the granularity of the ranges
    */
-  auto &get(size_t i, size_t j) {
-    return format_t::ordering(_elements, i, j, _dimen);
+  template <class F>
+  static void for_ranges(size_t count, size_t work, F const &f,
+                         size_t align = 1) {
+    size_t length = grain(count, work, align);
+    for_each((count + length - 1) / length, work, [&](size_t t) {
+      size_t first = t * length;
+      f(first, count - first < length ? count : first + length);
+    });
   }
+
   /**
-   * @brief Returns the value from the ith position in flat array
+   * @brief Runs f(first, last) over one range of [0, count) per thread of the
+   * current executor, each on the same thread in every call, see
+   * executor::run_pinned. Ranges written this way stay on the NUMA node of the
+   * thread that first touched them. A serial loop is the single range.
    *
-   * @param i the index to look for
-   * @return dtype the value returned
+   * @tparam F the type of the task
+   * @param count the elements in the loop
+   * @param work the work of the whole loop, see parallel
+   * @param f the task
    */
-  auto get(size_t i) const { return _elements[i]; }
+  template <class F>
+  static void for_partitions(size_t count, size_t work, F const &f) {
+    executor &e = current();
+    size_t parts = e.concurrency();
+    if (parts < 2 || count < 2 || !parallel(work)) {
+      if (count != 0) f(size_t(0), count);
+      return;
+    }
+    e.run_pinned(parts, std::function<void(size_t)>([&](size_t p) {
+                   size_t first = count * p / parts;
+                   size_t last = count * (p + 1) / parts;
+                   if (first != last) f(first, last);
+                 }));
+  }
 
   /**
-   * @brief Returns the value from the ith position in flat array by reference
+   * @brief The work below which loops stay serial, see set_parallel_threshold
    *
-   * @param i the index to look for
-   * @return dtype the value returned by reference
+   * @return size_t the current threshold
    */
-  auto &get(size_t i) { return _elements[i]; }
+  static size_t parallel_threshold() {
+    return _threshold().load(std::memory_order_relaxed);
+  }
 
   /**
-   * @brief Get the dimension of the matrix
+   * @brief Overrides the calibrated threshold from now on, 0 makes every loop
+   * parallel. Loops already running keep their decision.
    *
-   * @return dimension the dimension of the matrix.
+   * @param threshold the new threshold
    */
-  auto get_dimension() const { return _dimen; }
+  static void set_parallel_threshold(size_t threshold) {
+    _threshold().store(threshold, std::memory_order_relaxed);
+  }
 
   /**
-   * @brief Get the format policy object
+   * @brief Checks if a loop doing work units of work should open a parallel
+   * region
    *
-   * @return the format policy object
+   * @param work the elements in the loop times the cost of each, 0 keeps the
+   * loop on the calling thread whatever the threshold
+   * @return true if the loop should run in parallel
    */
-  auto get_format() const { return _format; }
+  static bool parallel(size_t work) {
+    return work != 0 && work >= parallel_threshold();
+  }
 
   /**
-   * @brief Construct a new lazy matrix object
+   * @brief The calibration file, MATRIX_CALIBRATION_FILE when set. Empty
+   * when there is none, the calibrated threshold then only lives in memory
+   * and callers may keep it with save.
    *
-   * @param rc the rows in the matrix
-   * @param cc the columns in the matrix
+   * @return std::string the path of the file
    */
-  matrix(size_t rc, size_t cc) : _dimen(rc, cc) { _construct_container(); }
+  static std::string calibration_file() {
+    if (char const *path = std::getenv("MATRIX_CALIBRATION_FILE")) return path;
+    return std::string();
+  }
+
   /**
-   * @brief Construct a new matrix object from an initializer list.
+   * @brief Measures the cost of running one task per thread on the current
+   * executor against the cost of an elementwise operation done serially, and
+   * returns the work at which a parallel loop saves twice that cost. With a
+   * single thread loops are always serial.
    *
-   * @param elem the initializer list of initialiazer lists
+   * @return size_t the measured threshold
    */
-  // cppcheck-suppress noExplicitConstructor
-  matrix(std::initializer_list<std::initializer_list<value_t>> elem)
-      : _dimen(elem.size(), elem.begin()->size()) {
-    _construct_container();
-    for (auto e : elem) {
-      if (e.size() != _dimen.col_dimen)
-        std::logic_error(
-            "Cannot create a matrix out of the provided initializer_list. "
-            "Length of each initializer list must be same");
+  static size_t calibrate() {
+    size_t threads = _threads();
+    if (threads < 2) return std::numeric_limits<size_t>::max();
+    using clock = std::chrono::steady_clock;
+    constexpr size_t elements = size_t(1) << 14, rounds = 64;
+    std::vector<double> a(elements, 1.0), b(elements, 2.0);
+    std::function<void(size_t)> touch = [&](size_t t) { a[t] += 1.0; };
+    double fork_join = std::numeric_limits<double>::max();
+    double per_element = std::numeric_limits<double>::max();
+    for (size_t trial = 0; trial < 5; trial++) {
+      auto t0 = clock::now();
+      for (size_t r = 0; r < rounds; r++) current().run(threads, touch);
+      auto t1 = clock::now();
+      for (size_t r = 0; r < rounds; r++) {
+        double *out = a.data();
+        for (size_t i = 0; i < elements; i++) out[i] = out[i] * b[i] + 1.0;
+        _clobber(out);
+      }
+      auto t2 = clock::now();
+      fork_join = std::min(
+          fork_join, std::chrono::duration<double>(t1 - t0).count() / rounds);
+      per_element = std::min(per_element,
+                             std::chrono::duration<double>(t2 - t1).count() /
+                                 (rounds * elements));
     }
-    std::vector<std::vector<value_t>> res;
-    for (auto &e : elem) res.push_back(e);
-    format_t::fill(_elements, res);
+    double threshold = 2 * fork_join / per_element;
+    return static_cast<size_t>(
+        std::min(std::max(threshold, 1024.0), double(size_t(1) << 26)));
   }
+
   /**
-   * @brief Construct a new lazy matrix object from vectors
+   * @brief Reads a threshold saved by save. Thresholds measured with another
+   * number of threads are ignored.
    *
-   * @param elem vectors of vectors of elements.
+   * @param path the file to read
+   * @param threshold set to the saved threshold when the file holds one
+   * @return true if the file held a threshold for this number of threads
    */
-  // cppcheck-suppress noExplicitConstructor
-  matrix(std::vector<std::vector<value_t>> elem)
-      : _dimen(elem.size(), elem[0].size()) {
-    _construct_container();
-    for (auto e : elem) {
-      if (e.size() != _dimen.col_dimen)
-        std::logic_error(
-            "Cannot create a matrix out of the provided vector of "
-            "vector.Lenght of each vector must be same");
-    }
-    format_t::fill(_elements, elem);
+  static bool load(std::string const &path, size_t &threshold) {
+    std::ifstream in(path);
+    std::string key, threads_key;
+    size_t value, threads;
+    if (!(in >> key >> value >> threads_key >> threads) ||
+        key != "parallel_threshold" || threads_key != "threads" ||
+        threads != _threads())
+      return false;
+    threshold = value;
+    return true;
   }
 
   /**
-   * @brief Construct a new matrix object from an expression type. The
-   * Expression will be evaluated to initialize the new variable.
+   * @brief Saves the current threshold so that later processes skip the
+   * calibration run.
    *
-   * @tparam E the expression template paramater
-   * @param expr the expression to create the matrix from
+   * @param path the file to write
+   * @return true if the file was written
    */
-
-  template <typename E>
-  matrix(expression<E> const &expr) : _dimen(expr.get_dimension()) {
-    _construct_container();
-#pragma omp parallel for
-    for (size_t a = 0; a < _dimen.count(); a++) _safe_copy(expr, a);
-  }
-
-  matrix(matrix &&other) : _dimen(std::move(other.get_dimension())) {
-    _construct_container();
-#pragma omp parallel for
-    for (size_t i = 0; i < this->_dimen.count(); i++) _safe_move(other, i);
+  static bool save(std::string const &path) {
+    return _write(path, parallel_threshold());
   }
 
+ private:
   /**
-   * @brief Construct a new matrix object from an rvalue expression
+   * @brief The threshold at first use, see execution
    *
-   * @tparam E the expression template
-   * @param expr the actual expression
    */
-
-  template <typename E>
-  matrix(expression<E> &&expr) : _dimen(expr.get_dimension()) {
-    _construct_container();
-#pragma omp parallel for
-    for (size_t a = 0; a < _dimen.count(); a++) _safe_move(expr, a);
+  static size_t _initial() {
+    if (char const *value = std::getenv("MATRIX_PARALLEL_THRESHOLD"))
+      return std::strtoull(value, nullptr, 10);
+    std::string path = calibration_file();
+    size_t threshold = 0;
+    if (!path.empty() && load(path, threshold)) return threshold;
+    threshold = calibrate();
+    if (!path.empty()) _write(path, threshold);
+    return threshold;
   }
 
   /**
-   * @brief Assignment from an expression will cause the expression to be
-   * evaluated.
+   * @brief Makes the compiler assume the memory at p is read here, so that
+   * the stores of the serial reference loop of calibrate are kept without
+   * turning them into volatile, scalar ones.
    *
-   * @tparam E the expression template type, should be deduced by compiler.
-   * @param expr the expression from which to evaluate.
-   * @return lazy_matrix& the reference to *this
    */
-
-  template <typename E>
-  auto &operator=(expression<E> const &expr) {
-    util::assert_same_dimensions(*this, expr);
-#pragma omp parallel for
-    for (size_t i = 0; i < this->_dimen.count(); i++) _safe_copy(expr, i);
-    return *this;
+  static void _clobber(void const *p) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r"(p) : "memory");
+#else
+    static void const *volatile sink;
+    sink = p;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
   }
 
   /**
-   * @brief Assignment from an expression will cause the expression to be
-   * evaluated. It evaluates the lvalue and swaps with this
+   * @brief the number of threads a parallel loop would use
    *
-   * @tparam E the expression template type, should be deduced by compiler.
-   * @param expr the expression from which to evaluate.
-   * @return lazy_matrix& the reference to *this
    */
-
-  template <typename E>
-  auto &operator=(expression<E> &&expr) {
-    util::assert_same_dimensions(*this, expr);
-#pragma omp parallel for
-    for (size_t i = 0; i < this->_dimen.count(); i++) _safe_move(expr, i);
-    return *this;
-  }
+  static size_t _threads() { return current().concurrency(); }
 
   /**
-   * @brief Assignment from other Matrix Variable.
+   * @brief the threshold, read by every loop while others may set it
    *
-   * @param other the value with which to assign this variable.
-   * @return lazy_matrix& the reference to *this
    */
-  auto &operator=(matrix const &other) {
-    if (this != &other) {
-      util::assert_same_dimensions(*this, other);
-#pragma omp parallel for
-      for (size_t i = 0; i < this->_dimen.count(); i++) _safe_copy(other, i);
-      return *this;
-    }
-  }
-
-  auto &operator=(matrix &&other) {
-    if (this != &other) {
-      util::assert_same_dimensions(*this, other);
-#pragma omp parallel for
-      for (size_t i = 0; i < this->_dimen.count(); i++) _safe_move(other, i);
-      return *this;
-    }
+  static std::atomic<size_t> &_threshold() {
+    static std::atomic<size_t> threshold{_initial()};
+    return threshold;
   }
 
   /**
-   * @brief Add and Assignment overload with expression. It will cause
-   * expression to be evaluated
+   * @brief the injected executor, null for the default pool
    *
-   * @tparam E the expression template paramater
-   * @param expr the expression with which we will evaluate and assign to *this
-   * @return matrix& the reference to *this
    */
-
-  template <typename E>
-  matrix &operator+=(expression<E> const &expr) {
-    util::assert_same_dimensions(*this, expr);
-#pragma omp parallel for
-    for (size_t a = 0; a < _dimen.count(); a++)
-      _elements[a] += expr.get(_safe_copy(expr, a));
-    return *this;
+  static std::atomic<executor *> &_current() {
+    static std::atomic<executor *> injected{nullptr};
+    return injected;
   }
 
   /**
-   * @brief Subtract and Assignment overload with expression. It will cause
-   * expression to be evaluated
+   * @brief Writes threshold to path in the format load reads
    *
-   * @tparam E the expression template paramater
-   * @param expr the expression with which we will evaluate and assign to *this
-   * @return matrix& the reference to *this
    */
+  static bool _write(std::string const &path, size_t threshold) {
+    std::ofstream out(path, std::ios::trunc);
+    out << "parallel_threshold " << threshold << "\nthreads " << _threads()
+        << "\n";
+    return bool(out);
+  }
+};
 
-  template <typename E>
-  matrix &operator-=(expression<E> const &expr) {
-    util::assert_same_dimensions(*this, expr);
-#pragma omp parallel for
-    for (size_t a = 0; a < _dimen.count(); a++)
-      _elements[a] -= expr.get(_safe_copy(expr, a));
+#if defined(MATRIX_INSTRUMENT)
+/**
+ * @brief This namespace holds the evaluation counters, compiled in only when
+ * MATRIX_INSTRUMENT is defined. Every constructor, assignment and product
+ * evaluation of a matrix adds to the counters of its operation at the current
+ * call site: the innermost MATRIX_INSTRUMENT_SCOPE alive on the calling
+ * thread, or "(unscoped)".
+ *
+ */
+namespace instrument {
+
+/**
+ * @brief What an operation did. Bytes are estimated from the elements, one
+ * read per leaf of the expression, see util::bytes_read. Layout conversions
+ * count the evaluations that map indices between row and column major
+ * operands, element by element.
+ *
+ */
+struct counters {
+  size_t calls = 0, evaluations = 0, elements = 0, bytes_read = 0,
+         bytes_written = 0, layout_conversions = 0, allocations = 0;
+  double seconds = 0;
+
+  counters &operator+=(counters const &other) {
+    calls += other.calls;
+    evaluations += other.evaluations;
+    elements += other.elements;
+    bytes_read += other.bytes_read;
+    bytes_written += other.bytes_written;
+    layout_conversions += other.layout_conversions;
+    allocations += other.allocations;
+    seconds += other.seconds;
     return *this;
   }
+};
+
+/**
+ * @brief The counters of one operation at one call site
+ *
+ */
+struct entry {
+  std::string site;
+  std::string operation;
+  counters stats;
+};
+
+/**
+ * @brief The counters of the process, by call site and operation
+ *
+ */
+class registry {
+  std::mutex _lock;
+  std::vector<entry> _entries;
+
+ public:
+  static registry &global() {
+    static registry r;
+    return r;
+  }
 
   /**
-   * @brief Multiply and Assignment overload with expression. It will cause
-   * expression to be evaluated
+   * @brief Adds c to the counters of operation at site
    *
-   * @tparam E the expression template paramater
-   * @param expr the expression with which we will evaluate and assign to *this
-   * @return matrix& the reference to *this
    */
-
-  template <typename E>
-  matrix &operator*=(expression<E> const &expr) {
-    util::assert_same_dimensions(*this, expr);
-#pragma omp parallel for
-    for (size_t a = 0; a < _dimen.count(); a++)
-      _elements[a] *= expr.get(_safe_copy(expr, a));
-    return *this;
+  void add(std::string const &site, char const *operation,
+           counters const &c) {
+    std::lock_guard<std::mutex> guard(_lock);
+    for (auto &e : _entries)
+      if (e.site == site && e.operation == operation) {
+        e.stats += c;
+        return;
+      }
+    _entries.push_back({site, operation, c});
   }
 
   /**
-   * @brief Division and Assignment overload with expression. It will cause
-   * expression to be evaluated
+   * @brief The counters of operation at site, zero when it never ran there.
+   * An empty site sums all sites.
    *
-   * @tparam E the expression template paramater
-   * @param expr the expression with which we will evaluate and assign to *this
-   * @return matrix& the reference to *this
    */
-
-  template <typename E>
-  matrix &operator/=(expression<E> const &expr) {
-    util::assert_same_dimensions(*this, expr);
-#pragma omp parallel for
-    for (size_t a = 0; a < _dimen.count(); a++)
-      _elements[a] /= expr.get(_safe_copy(expr, a));
-    return *this;
+  counters find(std::string const &site, std::string const &operation) {
+    std::lock_guard<std::mutex> guard(_lock);
+    counters total;
+    for (auto const &e : _entries)
+      if ((site.empty() || e.site == site) && e.operation == operation)
+        total += e.stats;
+    return total;
   }
 
   /**
-   * @brief Scaler Addition to all the elements in the matrix. Type
-   * must have an overload with + operator to dtype of matrix.
+   * @brief A copy of all counters, the most time consuming first
    *
-   * @tparam T the type to add.
-   * @param t the value to add to all element.
    */
+  std::vector<entry> entries() {
+    std::lock_guard<std::mutex> guard(_lock);
+    std::vector<entry> copy = _entries;
+    std::stable_sort(copy.begin(), copy.end(),
+                     [](entry const &a, entry const &b) {
+                       return a.stats.seconds > b.stats.seconds;
+                     });
+    return copy;
+  }
 
-  template <typename T>
-  void scalar_add(T t) {
-#pragma omp parallel for
-    for (size_t a = 0; a < _dimen.count(); a++) _elements[a] += t;
+  void reset() {
+    std::lock_guard<std::mutex> guard(_lock);
+    _entries.clear();
   }
 
   /**
-   * @brief Scaler subtraction to all the elements in the matrix.
-   * Type must have an overload with - operator to dtype of matrix.
+   * @brief Writes one line per call site and operation, see entries
    *
-   * @tparam T the type to subtract.
-   * @param t the value to subtracted from all element.
+   * @param out the stream to write to
    */
+  void dump(std::ostream &out = std::cerr) {
+    for (auto const &e : entries()) {
+      auto const &c = e.stats;
+      out << e.site << " " << e.operation << ": " << c.calls << " calls, "
+          << c.evaluations << " evaluations, " << c.elements << " elements, "
+          << c.bytes_read << " B read, " << c.bytes_written << " B written, "
+          << c.layout_conversions << " layout conversions, " << c.allocations
+          << " allocations, " << c.seconds * 1e3 << " ms\n";
+    }
+  }
+};
 
-  template <typename T>
-  void scalar_sub(int t) {
-#pragma omp parallel for
-    for (size_t a = 0; a < _dimen.count(); a++) _elements[a] -= t;
+/**
+ * @brief Names the call site of the operations run on this thread while it
+ * is alive, see MATRIX_INSTRUMENT_SCOPE
+ *
+ */
+class scope {
+  std::string _previous;
+
+  static std::string &_current() {
+    thread_local std::string site;
+    return site;
+  }
+
+ public:
+  scope(char const *name, char const *file, int line)
+      : _previous(_current()) {
+    _current() = std::string(name) + " (" + file + ":" + std::to_string(line) +
+                 ")";
   }
+  scope(scope const &) = delete;
+  scope &operator=(scope const &) = delete;
+  ~scope() { _current() = std::move(_previous); }
 
   /**
-   * @brief Scaler Multiplication to all the elements in the
-   * matrix. Type must have an overload with * operator to dtype of matrix.
+   * @brief the innermost site of the calling thread
    *
-   * @tparam T the type to multiply.
-   * @param t the value to multiply to all element.
    */
+  static std::string current() {
+    return _current().empty() ? std::string("(unscoped)") : _current();
+  }
+};
 
-  template <typename T>
-  void scalar_mul(T t) {
-#pragma omp parallel for
-    for (size_t a = 0; a < _dimen.count(); a++) _elements[a] *= t;
+/**
+ * @brief Times one operation and collects its counters, which are added to
+ * the registry when it ends. Counts go to the innermost probe of the thread,
+ * time is inclusive of nested probes. A probe that counted nothing, like the
+ * construction of an empty matrix, is not recorded.
+ *
+ */
+class probe {
+  char const *_operation;
+  probe *_outer;
+  std::chrono::steady_clock::time_point _start;
+
+  static probe *&_innermost() {
+    thread_local probe *p = nullptr;
+    return p;
+  }
+
+ public:
+  counters stats;
+
+  explicit probe(char const *operation)
+      : _operation(operation),
+        _outer(_innermost()),
+        _start(std::chrono::steady_clock::now()) {
+    _innermost() = this;
+  }
+  probe(probe const &) = delete;
+  probe &operator=(probe const &) = delete;
+  ~probe() {
+    _innermost() = _outer;
+    if (stats.evaluations == 0 && stats.elements == 0 &&
+        stats.allocations == 0 && stats.bytes_written == 0)
+      return;
+    stats.calls = 1;
+    stats.seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - _start)
+                        .count();
+    registry::global().add(scope::current(), _operation, stats);
   }
 
   /**
-   * @brief Prints the content of a matrix to the stream. Default to std::cout
+   * @brief the innermost probe of the calling thread, null outside any
    *
-   * @param stream the stream to print the values.
    */
-
-  void view(std::ostream &stream = std::cout) {
-    auto min_row = (10 > _dimen.row_dimen ? _dimen.row_dimen : 10);
-    auto min_col = (10 > _dimen.col_dimen ? _dimen.col_dimen : 10);
-#pragma omp parallel for
-    for (size_t i = 0; i < min_row; i++) {
-#pragma omp parallel for
-      for (size_t j = 0; j < min_col; j++) stream << _elements.get(i, j) << " ";
-      stream << "\n";
-    }
-  }
+  static probe *current() { return _innermost(); }
 };
 
+}  // namespace instrument
+
+#define MATRIX_INSTRUMENT_CONCAT_(a, b) a##b
+#define MATRIX_INSTRUMENT_CONCAT(a, b) MATRIX_INSTRUMENT_CONCAT_(a, b)
 /**
- * @brief This operator will check if the expression and the matrix have same
- * value. It will cause the expression to be evalauted.
+ * @brief Names the call site of the matrix operations in the enclosing block,
+ * e.g. MATRIX_INSTRUMENT_SCOPE("update weights");
  *
- * @tparam E the template parameter of expression
- * @param expr the expresssion type to evaluate
- * @return true if the expresssion's evaluated value is same as this
- * @return false otherwise
  */
+#define MATRIX_INSTRUMENT_SCOPE(name)                            \
+  ::test::instrument::scope MATRIX_INSTRUMENT_CONCAT(            \
+      matrix_instrument_scope_, __LINE__)(name, __FILE__, __LINE__)
+#define MATRIX_PROBE(operation) \
+  ::test::instrument::probe matrix_instrument_probe(operation)
+#define MATRIX_COUNT(field, n)                                       \
+  do {                                                               \
+    if (auto *p = ::test::instrument::probe::current())              \
+      p->stats.field += (n);                                         \
+  } while (false)
+#else
+#define MATRIX_INSTRUMENT_SCOPE(name) static_assert(true, "")
+#define MATRIX_PROBE(operation) static_assert(true, "")
+#define MATRIX_COUNT(field, n) static_cast<void>(0)
+#endif
 
 /**
- * @brief The == (equality) operator overload. Checks lexpr is equal to expr
+ * @brief An unnamed namespace we want for current file only.
  *
- * @tparam E the expression template
- * @param lexpr the left side expression
- * @param expr the right side expression
- * @return true if they are same
- * @return false otherwise
  */
-template <typename E>
-bool operator==(expression<E> const &lexpr, expression<E> const &expr) {
-  util::assert_same_dimensions(lexpr, expr);
-  for (size_t a = 0; a < lexpr.get_dimension().count(); a++)
-    if (lexpr.get(a) != expr.get(util::safe_index(lexpr, expr, a)))
-      return false;
-  return true;
-}
-
+namespace {
 /**
- * @brief Constructs a representation of node for add operation in the Abstract
- * Syntax Tree
+ * @brief Some internal utility functions
  *
- * @tparam E1 the first operand type
- * @tparam E2 the second operand type
  */
-template <typename E1, typename E2>
-class add_expr : public expression<add_expr<E1, E2>> {
-  E1 const &_u;
-  E2 const &_v;
-
- public:
+struct util {
   /**
-   * @brief Construct a new add expr object
+   * @brief true when the two format policies lay the elements out in the same
+   * order, regardless of the value type they were instantiated with.
    *
-   * @param u the first operand
-   * @param v the second operand
+   * @tparam F1 the first format policy
+   * @tparam F2 the second format policy
    */
-  add_expr(E1 const &u, E2 const &v) : _u(u), _v(v) {
-    util::assert_same_dimensions(u, v);
-  }
+  template <class F1, class F2>
+  static constexpr bool same_layout = F1::is_row_major == F2::is_row_major;
 
   /**
-   * @brief returns the value at i in the result
+   * @brief Extent of the tiles used to walk two different layouts at once,
+   * along the contiguous axis of the destination. The lines of a strided
+   * operand touched by one tile row stay in L1 until the next tile row
+   * reuses them.
    *
-   * @param i the row index
-   * @return dtype the element of the matrix or expression
    */
-
-  auto get(size_t i) const {
-    return _u.get(i) + _v.get(util::safe_index(_u, _v, i));
-  }
+  static constexpr size_t tile_along = 256;
 
   /**
-   * @brief Get the dimension of this expression object.
+   * @brief Extent of the tiles across the contiguous axis of the destination.
+   * Kept short so that the pages of one tile fit in the TLB.
    *
-   * @return dimension of the expression.
    */
-
-  auto get_dimension() const { return _u.get_dimension(); }
+  static constexpr size_t tile_across = 16;
 
   /**
-   * @brief Get the format object. Please note all the formats will collapse to
-   * the format of first operand. Natrually because of our evaluation startegy.
+   * @brief Converts the indexes from one to other format if necessary. The
+   * decision is made at compile time so the same layout case costs nothing.
    *
-   * @return the type of the format used in this matrix
+   * @tparam E1 the template paramater for the first type
+   * @tparam E2 the template parameter for the second type
+   * @param expr1 the first expression
+   * @param expr2 the second expression
+   * @param target the target index to convert. Index corresponsing to expr1's
+   * format
+   * @return size_t the index that will work in expr2's format.
    */
+  template <class E1, class E2>
+  static size_t safe_index(E1 const &expr1, E2 const &expr2, size_t target) {
+    (void)expr2;
+    using F1 = decltype(expr1.get_format());
+    using F2 = decltype(expr2.get_format());
+    if constexpr (same_layout<F1, F2>)
+      return target;
+    else
+      return F1::to_other_major(target, expr1.get_dimension());
+  }
 
-  auto get_format() const { return _u.get_format(); }
-};
-
-/**
- * @brief Constructs a representation of node for subtraction operation in the
- * Abstract Syntax Tree
- *
- * @tparam E1 the first operand type
- * @tparam E2 the second operand type
- */
-template <typename E1, typename E2>
-class sub_expr : public expression<sub_expr<E1, E2>> {
-  E1 const &_u;
-  E2 const &_v;
-
- public:
   /**
-   * @brief Construct a new sub expr object
+   * @brief Calls f(i, j) once for every element of a dimension, tile by tile.
+   * Tiles are tile_across lines of tile_along elements of the layout given by
+   * row_major, visited in that layout's order, and are distributed among the
+   * threads. Walking two different layouts this way keeps both of them within
+   * a few cache lines and pages per tile instead of striding one of them by a
+   * full dimension.
    *
-   * @param u the first operand
-   * @param v the second operand
+   * @tparam row_major true to visit a tile row by row, false column by column
+   * @tparam F the type of the callback
+   * @param dimen the dimension to walk
+   * @param f the callback
+   * @param cost the work of one call of f, see execution
    */
-  sub_expr(E1 const &u, E2 const &v) : _u(u), _v(v) {
-    util::assert_same_dimensions(u, v);
+  template <bool row_major, class F>
+  static void for_each_tiled(dimension const &dimen, F const &f,
+                             size_t cost = 1) {
+    size_t rows = row_major ? tile_across : tile_along;
+    size_t cols = row_major ? tile_along : tile_across;
+    size_t row_tiles = (dimen.row_dimen + rows - 1) / rows;
+    size_t col_tiles = (dimen.col_dimen + cols - 1) / cols;
+    size_t tiles = row_tiles * col_tiles;
+    execution::for_each(tiles, dimen.count() * cost, [&](size_t t) {
+      size_t r0 = (row_major ? t / col_tiles : t % row_tiles) * rows;
+      size_t c0 = (row_major ? t % col_tiles : t / row_tiles) * cols;
+      size_t r1 = r0 + rows < dimen.row_dimen ? r0 + rows : dimen.row_dimen;
+      size_t c1 = c0 + cols < dimen.col_dimen ? c0 + cols : dimen.col_dimen;
+      if constexpr (row_major) {
+        for (size_t i = r0; i < r1; i++)
+          for (size_t j = c0; j < c1; j++) f(i, j);
+      } else {
+        for (size_t j = c0; j < c1; j++)
+          for (size_t i = r0; i < r1; i++) f(i, j);
+      }
+    });
   }
-
   /**
-   * @brief returns the value at i in the result
+   * @brief Checks if two arguments have same dimension
    *
-   * @param i the row index
-   * @return dtype the element of the matrix or expression
+   * @tparam A the type of first argument
+   * @tparam B the type of second argument
+   * @param a the first argument
+   * @param b the second argument
    */
-
-  auto get(size_t i) const {
-    return _u.get(i) - _v.get(util::safe_index(_u, _v, i));
+  template <class A, class B>
+  static void assert_same_dimensions(A const &a, B const &b) {
+    if (a.get_dimension() != b.get_dimension())
+      throw std::logic_error(
+          std::string(
+              "Dimension assertion failed. Required same dimensions found ") +
+          a.get_dimension().to_string() + std::string(" and ") +
+          b.get_dimension().to_string());
   }
 
   /**
-   * @brief Get the dimension of this expression object.
+   * @brief the iterator over a container of rows
    *
-   * @return dimension of the expression.
    */
-  auto get_dimension() const { return _u.get_dimension(); }
+  template <class rows_t>
+  using row_iterator_t = decltype(std::begin(std::declval<rows_t const &>()));
 
   /**
-   * @brief Get the format object. Please note all the formats will collapse to
-   * the format of first operand. Natrually because of our evaluation startegy.
+   * @brief the iterator over the elements of one row of a container of rows
    *
-   * @return the type of the format used in this matrix / expression
+   */
+  template <class rows_t>
+  using element_iterator_t =
+      decltype(std::begin(*std::declval<row_iterator_t<rows_t>>()));
+
+  /**
+   * @brief true when both the container of rows and each row can be indexed
+   * in O(1), so rows can be filled from in any order and in parallel.
+   *
+   * @tparam rows_t the type of the container of rows
+   */
+  template <class rows_t>
+  static constexpr bool random_access_rows =
+      std::is_base_of<std::random_access_iterator_tag,
+                      typename std::iterator_traits<
+                          row_iterator_t<rows_t>>::iterator_category>::value &&
+      std::is_base_of<
+          std::random_access_iterator_tag,
+          typename std::iterator_traits<
+              element_iterator_t<rows_t>>::iterator_category>::value;
+
+  /**
+   * @brief Edge of the square blocks a column major fill transposes at once.
+   *
+   */
+  static constexpr size_t fill_block = 32;
+
+  /**
+   * @brief true when E is a node of an expression tree
+   *
+   * @tparam E the type to check
+   */
+  template <class E>
+  static constexpr bool is_expression =
+      std::is_base_of<expression<E>, E>::value;
+
+  /**
+   * @brief true when S can be broadcast as a scalar operand of an expression
+   *
+   * @tparam S the type to check
+   */
+  template <class S, class = void>
+  struct is_scalar : std::is_arithmetic<S> {};
+
+  template <class S>
+  struct is_scalar<S, std::enable_if_t<std::is_same<
+                          S, std::complex<typename S::value_type>>::value>>
+      : std::true_type {};
+
+  /**
+   * @brief How a node keeps its operand of type E. Nodes refer to their
+   * operands, except the ones flagged stored_by_value, like broadcast
+   * scalars, which are created inside an operator and would dangle.
+   *
+   * @tparam E the type of the operand
+   */
+  template <class E, class = void>
+  struct operand {
+    using type = E const &;
+  };
+
+  template <class E>
+  struct operand<E, std::enable_if_t<E::stored_by_value>> {
+    using type = E const;
+  };
+
+  template <class E>
+  using operand_t = typename operand<E>::type;
+
+  /**
+   * @brief The number of matrix products reachable from E through elementwise
+   * nodes only, read from E::fused_products when E declares it. A tree with
+   * exactly one can run its elementwise tail in the store phase of the
+   * product kernel.
+   *
+   * @tparam E the type of the expression
+   */
+  template <class E, class = void>
+  struct fused_products : std::integral_constant<size_t, 0> {};
+
+  template <class E>
+  struct fused_products<E, std::enable_if_t<(E::fused_products > 0)>>
+      : std::integral_constant<size_t, E::fused_products> {};
+
+  /**
+   * @brief true when element (i, j) of E reads its leaves only at (i, j),
+   * read from E::pointwise when E declares it. Such a tree may be assigned in
+   * place to one of its leaves. Other trees, like transposes, block views and
+   * broadcasts of a line, go through a temporary when they read their
+   * destination.
+   *
+   * @tparam E the type of the expression
+   */
+  template <class E, class = void>
+  struct pointwise : std::false_type {};
+
+  template <class E>
+  struct pointwise<E, std::enable_if_t<E::pointwise>> : std::true_type {};
+
+  /**
+   * @brief The work of evaluating one element of E, read from E::cost when E
+   * declares it: one per leaf read and per operation. Loops weigh their
+   * element count by it to pick serial or parallel execution.
+   *
+   * @tparam E the type of the expression
+   */
+  template <class E, class = void>
+  struct cost : std::integral_constant<size_t, 1> {};
+
+  template <class E>
+  struct cost<E, std::enable_if_t<(E::cost > 0)>>
+      : std::integral_constant<size_t, E::cost> {};
+
+  /**
+   * @brief true when E has packet access and Map turns a packet of E into
+   * packet_t. The packet of E is only looked at when E::packet_access holds,
+   * so trees that cannot form packets never instantiate get_packet.
+   *
+   * @tparam E the type of the expression
+   * @tparam Map the per element transform
+   * @tparam packet_t the packet type the transform must return
+   */
+  template <class E, class Map, class packet_t, bool = E::packet_access>
+  struct maps_packets : std::false_type {};
+
+  template <class E, class Map, class packet_t>
+  struct maps_packets<E, Map, packet_t, true>
+      : std::is_same<decltype(std::declval<Map const &>()(
+                         std::declval<E const &>().get_packet(0))),
+                     packet_t> {};
+
+  /**
+   * @brief The bytes read to evaluate one element of E, from E::bytes_read
+   * when E declares it, else one element of its value type. Only the
+   * instrumentation uses it, see instrument::counters.
+   *
+   * @tparam E the type of the expression
+   */
+  template <class E, class = void>
+  struct bytes_read
+      : std::integral_constant<size_t, sizeof(typename E::value_type)> {};
+
+  template <class E>
+  struct bytes_read<E, std::void_t<decltype(E::bytes_read)>>
+      : std::integral_constant<size_t, E::bytes_read> {};
+
+  /**
+   * @brief true when E has a prepare hook
+   *
+   * @tparam E the type of the expression
+   */
+  template <class E, class = void>
+  struct has_prepare : std::false_type {};
+
+  template <class E>
+  struct has_prepare<
+      E, std::void_t<decltype(std::declval<E const &>().prepare(false))>>
+      : std::true_type {};
+
+  /**
+   * @brief true when E can tell which memory it reads
+   *
+   * @tparam E the type of the expression
+   */
+  template <class E, class = void>
+  struct has_references : std::false_type {};
+
+  template <class E>
+  struct has_references<
+      E, std::void_t<decltype(std::declval<E const &>().references(
+             std::declval<void const *>(), std::declval<void const *>()))>>
+      : std::true_type {};
+
+  /**
+   * @brief true when E can pass access hints down to its storage
+   *
+   * @tparam E the type of the expression
+   */
+  template <class E, class = void>
+  struct has_advise : std::false_type {};
+
+  template <class E>
+  struct has_advise<
+      E, std::void_t<decltype(std::declval<E const &>().advise(
+             size_t(), size_t(), storage::advice::done))>> : std::true_type {};
+
+  /**
+   * @brief Passes an access hint for the flat range [first, last) of e down to
+   * the storage of its leaves. Only meaningful when e has a uniform layout.
+   * Nodes owning their values ignore it.
+   *
+   * @tparam E the type of the expression or storage
+   * @param e the expression or storage
+   * @param first the first flat index of the range
+   * @param last one past the last flat index of the range
+   * @param a the hint
+   */
+  template <class E>
+  static void advise(E const &e, size_t first, size_t last,
+                     storage::advice a) {
+    if constexpr (has_advise<E>::value) e.advise(first, last, a);
+  }
+
+  /**
+   * @brief Runs the prepare hook of e, if any, before e is read. The hook
+   * materializes the products get(i, j) cannot compute on the fly.
+   *
+   * @tparam E the type of the expression
+   * @param e the expression about to be evaluated
+   * @param fused true when the caller evaluates the products reachable
+   * through elementwise nodes itself
+   */
+  template <class E>
+  static void prepare(E const &e, bool fused = false) {
+    if constexpr (has_prepare<E>::value) e.prepare(fused);
+  }
+
+  /**
+   * @brief Runs the release hook of e, which every node with a prepare hook
+   * has. It drops what prepare materialized, so the next evaluation reads the
+   * operands again.
+   *
+   * @tparam E the type of the expression
+   * @param e the expression that was evaluated
+   */
+  template <class E>
+  static void release(E const &e) {
+    if constexpr (has_prepare<E>::value) e.release();
+  }
+
+  /**
+   * @brief Prepares an expression for one evaluation, the lifetime of this
+   * object, and releases it at the end, see prepare and release.
+   *
+   * @tparam E the type of the expression
+   */
+  template <class E>
+  class prepared {
+    E const &_e;
+
+   public:
+    explicit prepared(E const &e, bool fused = false) : _e(e) {
+      prepare(e, fused);
+    }
+    prepared(prepared const &) = delete;
+    prepared &operator=(prepared const &) = delete;
+    ~prepared() { release(_e); }
+  };
+
+  /**
+   * @brief Checks if evaluating e reads any element in [first, last). Nodes
+   * owning their values, like scalars, never do.
+   *
+   * @tparam E the type of the expression
+   * @param e the expression
+   * @param first the first byte of the range
+   * @param last one past the last byte of the range
+   * @return true if e may read the range
+   */
+  template <class E>
+  static bool references(E const &e, void const *first, void const *last) {
+    if constexpr (has_references<E>::value)
+      return e.references(first, last);
+    else
+      return false;
+  }
+
+  /**
+   * @brief returns the value of e at row i and column j, with acc standing in
+   * for the single fused product below e.
+   *
+   * @tparam E the type of the expression
+   * @tparam acc_t the type of the product
+   * @param e the expression
+   * @param i the row index
+   * @param j the column index
+   * @param acc the value of the product at row i and column j
+   * @return the element of e
+   */
+  template <class E, class acc_t>
+  static auto get_fused(E const &e, size_t i, size_t j, acc_t const &acc) {
+    if constexpr (fused_products<E>::value > 0)
+      return e.get_fused(i, j, acc);
+    else
+      return e.get(i, j);
+  }
+
+  /**
+   * @brief true when rows_t is a container of rows whose elements convert to
+   * value_t, like a vector of vectors.
+   *
+   * @tparam rows_t the type to check
+   * @tparam value_t the element type of the matrix
+   */
+  template <class rows_t, class value_t, class = void>
+  struct is_rows : std::false_type {};
+
+  template <class rows_t, class value_t>
+  struct is_rows<rows_t, value_t,
+                 std::void_t<decltype(std::declval<rows_t const &>().size()),
+                             decltype(std::begin(std::declval<rows_t const &>())
+                                          ->size()),
+                             decltype(*std::begin(*std::begin(
+                                 std::declval<rows_t const &>())))>>
+      : std::is_convertible<decltype(*std::begin(
+                                *std::begin(std::declval<rows_t const &>()))),
+                            value_t> {};
+};
+}  // namespace
+
+namespace policy {
+
+template <class value_t>
+struct ColumnMajorPolicy;
+
+/**
+ * @brief Policy that specifies the Row Major Ordering to follow
+ *
+ * @tparam value_t the datatype of the matrix
+ */
+template <class value_t>
+struct RowMajorPolicy {
+  /**
+   * @brief Elements of a row are adjacent in memory
+   *
+   */
+  static constexpr bool is_row_major = true;
+
+  /**
+   * @brief The policy that reads the same buffer as the transpose
+   *
+   */
+  using transposed = ColumnMajorPolicy<value_t>;
+
+  /**
+   * @brief Actual Implementation of the ordering
+   *
+   * @param bucket the flattened matrix representation vector.
+   * @param indexX the row index that is requested
+   * @param indexY the column index that is requested
+   * @param dimen the dimension of the matrix
+   * @return value_t& the reference to the element being selected by this
+   * policy.
+   */
+  template <class bucket_t>
+  static auto &ordering(bucket_t &bucket, size_t indexX, size_t indexY,
+                        dimension dimen) {
+    return bucket[(indexX * (dimen.col_dimen)) + (indexY)];
+  }
+  /**if(std::is_same<_u.get_format(), _v.get_format()>::value) return
+   * @brief Actual Implementation of the ordering
+   *
+   * @param bucket the flattened matrix representation vector.
+   * @param indexX the row index that is requested
+   * @param indexY the column index that is requested
+   * @param dimen the dimension of the matrix
+   * @return value_t& the reference to the element being selected by this
+   * policy.
+   */
+  template <class bucket_t>
+  static auto ordering(bucket_t const &bucket, size_t indexX, size_t indexY,
+                       dimension dimen) {
+    return bucket[(indexX * (dimen.col_dimen)) + (indexY)];
+  }
+  /**
+   * @brief Fills the bucket of flattened array using Row major Ordering. Every
+   * element is read and written exactly once. Rows that can be indexed are
+   * copied in parallel, one row per iteration, otherwise in order.
+   *
+   * @param bucket the flattened bucket to fill the elements to.
+   * @param elems the elements as a container of rows, e.g. vector of vectors
+   * or initializer_list of initializer_lists.
+   */
+  template <class bucket_t, class rows_t>
+  static void fill(bucket_t &bucket, rows_t const &elems) {
+    if constexpr (util::random_access_rows<rows_t>) {
+      auto rows = std::begin(elems);
+      size_t row_counts = elems.size();
+      execution::for_ranges(
+          row_counts, bucket.size(), [&](size_t first, size_t last) {
+            for (size_t a = first; a < last; a++) {
+              size_t col_counts = rows[a].size();
+              auto row = std::begin(rows[a]);
+              for (size_t b = 0; b < col_counts; b++)
+                bucket[a * col_counts + b] = row[b];
+            }
+          });
+    } else {
+      size_t counter = 0;
+      for (auto &e : elems)
+        for (auto &E : e) bucket[counter++] = E;
+    }
+  }
+  /**
+   * @brief Converts the given index to its equivalent column major index.
+   *
+   * @param i the index whose equivalent is desired
+   * @param dimen the dimension of the matrix
+   * @return size_t return a value in range [0, row*columns)
+   */
+
+  static size_t to_other_major(size_t const &i, dimension const &dimen) {
+    size_t x = i / dimen.col_dimen;
+    size_t y = i % dimen.col_dimen;
+    return (y * dimen.row_dimen + x);
+  }
+};
+
+/**
+ * @brief Policy that specifies the Column Major Ordering to follow
+ *
+ * @tparam value_t the datatype of the matrix
+ */
+template <class value_t>
+struct ColumnMajorPolicy {
+  /**
+   * @brief Elements of a column are adjacent in memory
+   *
+   */
+  static constexpr bool is_row_major = false;
+
+  /**
+   * @brief The policy that reads the same buffer as the transpose
+   *
+   */
+  using transposed = RowMajorPolicy<value_t>;
+
+  /**
+   * @brief Actual Implementation of the ordering
+   *
+   * @param bucket the flattened matrix representation vector.
+   * @param indexX the row index that is requested
+   * @param indexY the column index that is requested
+   * @param dimen the dimension of the matrix
+   * @return value_t& the reference to the element being selected by this
+   * policy.
+   */
+  template <class bucket_t>
+  static auto &ordering(bucket_t &bucket, size_t indexX, size_t indexY,
+                        dimension dimen) {
+    return bucket[(indexY * (dimen.row_dimen)) + (indexX)];
+  }
+  /**
+   * @brief Actual Implementation of the ordering
+   *
+   * @param bucket the flattened matrix representation vector.
+   * @param indexX the row index that is requested
+   * @param indexY the column index that is requested
+   * @param dimen the dimension of the matrix
+   * @return value_t& the reference to the element being selected by this
+   * policy.
+   */
+  template <class bucket_t>
+  static auto ordering(bucket_t const &bucket, size_t indexX, size_t indexY,
+                       dimension dimen) {
+    return bucket[(indexY * (dimen.row_dimen)) + (indexX)];
+  }
+
+  /**
+   * @brief Fills the bucket of flattened array using Column major Ordering.
+   * Every element is read and written exactly once. Rows that can be indexed
+   * are transposed block by block: each thread owns a contiguous range of
+   * columns of the bucket and fills it one fill_block square at a time, so
+   * writes are contiguous runs and reads stay within a few lines per row.
+   * Other containers are walked in order.
+   *
+   * @param bucket the flattened bucket to fill the elements to.
+   * @param elems the elements as a container of rows, e.g. vector of vectors
+   * or initializer_list of initializer_lists.
+   */
+  template <class bucket_t, class rows_t>
+  static void fill(bucket_t &bucket, rows_t const &elems) {
+    size_t row_counts = elems.size();
+    if (row_counts == 0) return;
+    if constexpr (util::random_access_rows<rows_t>) {
+      constexpr size_t block = util::fill_block;
+      auto rows = std::begin(elems);
+      size_t col_counts = rows->size();
+      size_t col_blocks = (col_counts + block - 1) / block;
+      execution::for_each(col_blocks, bucket.size(), [&](size_t cb) {
+        size_t c0 = cb * block;
+        size_t c1 = c0 + block < col_counts ? c0 + block : col_counts;
+        decltype(std::begin(*rows)) row[block];
+        for (size_t r0 = 0; r0 < row_counts; r0 += block) {
+          size_t r1 = r0 + block < row_counts ? r0 + block : row_counts;
+          for (size_t b = r0; b < r1; b++) row[b - r0] = std::begin(rows[b]);
+          for (size_t a = c0; a < c1; a++)
+            for (size_t b = r0; b < r1; b++)
+              bucket[a * row_counts + b] = row[b - r0][a];
+        }
+      });
+    } else {
+      size_t b = 0;
+      for (auto &e : elems) {
+        size_t a = 0;
+        for (auto &E : e) bucket[(a++) * row_counts + b] = E;
+        b++;
+      }
+    }
+  }
+  /**
+   * @brief Converts the given index to its equivalent row major index.
+   *
+   * @param i the index whose equivalent is desired
+   * @param dimen the dimension of the matrix
+   * @return size_t return a value in range [0, row*columns)
+   */
+
+  static size_t to_other_major(size_t const &i, dimension const &dimen) {
+    size_t y = i / dimen.row_dimen;
+    size_t x = i % dimen.row_dimen;
+    return (x * dimen.col_dimen + y);
+  }
+};
+}  // namespace policy
+
+/**
+ * @brief This namespace holds the storage types a matrix can keep its elements
+ * in, and the traits the matrix uses to tell them apart.
+ *
+ */
+namespace storage {
+
+/**
+ * @brief Describes a storage type. Unknown storage types are treated as fixed
+ * size containers with operator[] and size().
+ *
+ * @tparam storage_t the storage type
+ */
+template <class storage_t>
+struct traits {
+  /**
+   * @brief true when the elements are adjacent in memory and data() points to
+   * the first one.
+   *
+   */
+  static constexpr bool contiguous = false;
+  /**
+   * @brief true when the matrix may construct the storage with any number of
+   * elements.
+   *
+   */
+  static constexpr bool resizable = false;
+};
+
+/**
+ * @brief std::vector with any allocator is contiguous and resizable.
+ *
+ */
+template <class value_t, class allocator_t>
+struct traits<std::vector<value_t, allocator_t>> {
+  static constexpr bool contiguous = !std::is_same<value_t, bool>::value;
+  static constexpr bool resizable = true;
+};
+
+/**
+ * @brief A storage that does not own its elements. It refers to a buffer that
+ * is owned elsewhere and must outlive every matrix using it. This is how a
+ * matrix adopts memory it did not allocate without copying it. It cannot be
+ * copied, and assigning one copies the elements into the buffer it refers to.
+ *
+ * @tparam value_t the type of the elements
+ */
+template <class value_t>
+class external {
+  value_t *_data = nullptr;
+  size_t _size = 0;
+
+ public:
+  /**
+   * @brief Construct a new empty external storage
+   *
+   */
+  external() = default;
+  /**
+   * @brief Construct a new external storage over a buffer
+   *
+   * @param data the first element of the buffer
+   * @param size the number of elements in the buffer
+   */
+  external(value_t *data, size_t size) : _data(data), _size(size) {}
+  /**
+   * @brief Moves the reference to the buffer, other is left empty
+   *
+   * @param other the storage to move from
+   */
+  external(external &&other) noexcept : _data(other._data), _size(other._size) {
+    other._data = nullptr;
+    other._size = 0;
+  }
+  external(external const &) = delete;
+  /**
+   * @brief Copies the elements of other into the buffer of this one, which
+   * keeps referring to its own buffer
+   *
+   * @param other the storage to copy from, of the same size
+   * @return external& the reference to *this
+   */
+  external &operator=(external const &other) {
+    if (_size != other._size)
+      throw std::logic_error(
+          std::string("Cannot copy an external storage of size ") +
+          std::to_string(other._size) + " into one of size " +
+          std::to_string(_size));
+    if (this != &other) std::copy_n(other._data, _size, _data);
+    return *this;
+  }
+  /**
+   * @brief Moves the reference to the buffer, other is left empty
+   *
+   * @param other the storage to move from
+   * @return external& the reference to *this
+   */
+  external &operator=(external &&other) noexcept {
+    _data = other._data;
+    _size = other._size;
+    other._data = nullptr;
+    other._size = 0;
+    return *this;
+  }
+  value_t &operator[](size_t i) { return _data[i]; }
+  value_t const &operator[](size_t i) const { return _data[i]; }
+  value_t *data() { return _data; }
+  value_t const *data() const { return _data; }
+  size_t size() const { return _size; }
+};
+
+/**
+ * @brief external storage is contiguous but can not be resized.
+ *
+ */
+template <class value_t>
+struct traits<external<value_t>> {
+  static constexpr bool contiguous = true;
+  static constexpr bool resizable = false;
+};
+
+/**
+ * @brief A standard allocator whose buffers start on an alignment byte
+ * boundary, by default a 64 byte cache line, the width of an AVX-512
+ * register. Use it through std::vector as the storage_t of a matrix, see
+ * aligned_vector.
+ *
+ * @tparam value_t the type of the elements
+ * @tparam alignment the alignment in bytes, a power of two
+ */
+template <class value_t, size_t alignment = 64>
+struct aligned_allocator {
+  using value_type = value_t;
+
+  /**
+   * @brief the same allocator for another element type
+   *
+   */
+  template <class other_t>
+  struct rebind {
+    using other = aligned_allocator<other_t, alignment>;
+  };
+
+  /**
+   * @brief the alignment actually used, never less than the one of value_t
+   *
+   */
+  static constexpr size_t bytes =
+      alignment < alignof(value_t) ? alignof(value_t) : alignment;
+
+  aligned_allocator() = default;
+  template <class other_t>
+  aligned_allocator(aligned_allocator<other_t, alignment> const &) noexcept {}
+
+  /**
+   * @brief Allocates an aligned buffer of n elements
+   *
+   * @param n the number of elements
+   * @return value_t* the first element of the buffer
+   */
+  value_t *allocate(size_t n) {
+    if (n > std::numeric_limits<size_t>::max() / sizeof(value_t))
+      throw std::bad_array_new_length();
+    return static_cast<value_t *>(
+        ::operator new(n * sizeof(value_t), std::align_val_t(bytes)));
+  }
+
+  /**
+   * @brief Releases a buffer returned by allocate
+   *
+   * @param p the first element of the buffer
+   */
+  void deallocate(value_t *p, size_t) noexcept {
+    ::operator delete(p, std::align_val_t(bytes));
+  }
+
+  template <class other_t>
+  bool operator==(aligned_allocator<other_t, alignment> const &) const {
+    return true;
+  }
+  template <class other_t>
+  bool operator!=(aligned_allocator<other_t, alignment> const &) const {
+    return false;
+  }
+};
+
+/**
+ * @brief A standard allocator backing large buffers with huge pages, which
+ * cuts the TLB misses of walking multi GB matrices. Buffers of at least one
+ * huge page are mapped with MAP_HUGETLB when the system has huge pages
+ * reserved. Otherwise they are mapped on a huge page boundary and advised
+ * with MADV_HUGEPAGE so that transparent huge pages back them. Smaller
+ * buffers, and systems without mmap, use aligned_allocator.
+ *
+ * @tparam value_t the type of the elements
+ */
+template <class value_t>
+struct huge_page_allocator {
+  using value_type = value_t;
+
+  /**
+   * @brief the size of a huge page, buffers are rounded up to a multiple
+   *
+   */
+  static constexpr size_t page_bytes = size_t(2) << 20;
+
+  huge_page_allocator() = default;
+  template <class other_t>
+  huge_page_allocator(huge_page_allocator<other_t> const &) noexcept {}
+
+  /**
+   * @brief Allocates a buffer of n elements, on huge pages if it spans one
+   *
+   * @param n the number of elements
+   * @return value_t* the first element of the buffer
+   */
+  value_t *allocate(size_t n) {
+    if (n > std::numeric_limits<size_t>::max() / sizeof(value_t) - page_bytes)
+      throw std::bad_array_new_length();
+    size_t length = _length(n);
+    if (length == 0) return aligned_allocator<value_t>().allocate(n);
+#if defined(MAP_ANONYMOUS)
+    void *p = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+    p = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (p == MAP_FAILED) {
+      // Over map by one page and trim both ends to start on a page boundary.
+      char *raw = static_cast<char *>(mmap(nullptr, length + page_bytes,
+                                           PROT_READ | PROT_WRITE,
+                                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+      if (static_cast<void *>(raw) == MAP_FAILED) throw std::bad_alloc();
+      size_t head = (page_bytes - reinterpret_cast<size_t>(raw) % page_bytes) %
+                    page_bytes;
+      if (head != 0) munmap(raw, head);
+      munmap(raw + head + length, page_bytes - head);
+      p = raw + head;
+#if defined(MADV_HUGEPAGE)
+      madvise(p, length, MADV_HUGEPAGE);
+#endif
+    }
+    return static_cast<value_t *>(p);
+#else
+    return aligned_allocator<value_t>().allocate(n);
+#endif
+  }
+
+  /**
+   * @brief Releases a buffer returned by allocate
+   *
+   * @param p the first element of the buffer
+   * @param n the number of elements it was allocated with
+   */
+  void deallocate(value_t *p, size_t n) noexcept {
+    size_t length = _length(n);
+#if defined(MAP_ANONYMOUS)
+    if (length != 0) {
+      munmap(p, length);
+      return;
+    }
+#endif
+    aligned_allocator<value_t>().deallocate(p, n);
+  }
+
+  template <class other_t>
+  bool operator==(huge_page_allocator<other_t> const &) const {
+    return true;
+  }
+  template <class other_t>
+  bool operator!=(huge_page_allocator<other_t> const &) const {
+    return false;
+  }
+
+ private:
+  /**
+   * @brief The mapped length of a buffer of n elements, 0 when it is smaller
+   * than one huge page and is not mapped.
+   *
+   * @param n the number of elements
+   * @return size_t the length in bytes
+   */
+  static size_t _length(size_t n) {
+    size_t bytes = n * sizeof(value_t);
+    if (bytes < page_bytes) return 0;
+    return (bytes + page_bytes - 1) / page_bytes * page_bytes;
+  }
+};
+
+/**
+ * @brief A vector whose buffer starts on a 64 byte boundary
+ *
+ * @tparam value_t the type of the elements
+ */
+template <class value_t>
+using aligned_vector = std::vector<value_t, aligned_allocator<value_t>>;
+
+/**
+ * @brief A vector whose large buffers are backed by huge pages
+ *
+ * @tparam value_t the type of the elements
+ */
+template <class value_t>
+using huge_page_vector = std::vector<value_t, huge_page_allocator<value_t>>;
+
+/**
+ * @brief A standard allocator leaving large buffers untouched so that each of
+ * their pages lands on the NUMA node of the thread first writing to it. Buffers
+ * of at least min_bytes are mapped anonymously and elements are constructed by
+ * default initialization, which writes nothing for trivial types. A matrix over
+ * such a storage zeroes and evaluates the same range of lines on the same
+ * thread every time, see execution::for_partitions. Smaller buffers, and
+ * systems without mmap, use aligned_allocator.
+ *
+ * @tparam value_t the type of the elements
+ */
+template <class value_t>
+struct first_touch_allocator {
+  using value_type = value_t;
+
+  /**
+   * @brief the size from which buffers are mapped, below it the pages are
+   * shared with other allocations anyway
+   *
+   */
+  static constexpr size_t min_bytes = size_t(64) << 10;
+
+  template <class other_t>
+  struct rebind {
+    using other = first_touch_allocator<other_t>;
+  };
+
+  first_touch_allocator() = default;
+  template <class other_t>
+  first_touch_allocator(first_touch_allocator<other_t> const &) noexcept {}
+
+  /**
+   * @brief Allocates a buffer of n elements without touching its pages
+   *
+   * @param n the number of elements
+   * @return value_t* the first element of the buffer
+   */
+  value_t *allocate(size_t n) {
+    if (n > std::numeric_limits<size_t>::max() / sizeof(value_t))
+      throw std::bad_array_new_length();
+#if defined(MAP_ANONYMOUS)
+    if (n * sizeof(value_t) >= min_bytes) {
+      void *p = mmap(nullptr, n * sizeof(value_t), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED) throw std::bad_alloc();
+      return static_cast<value_t *>(p);
+    }
+#endif
+    return aligned_allocator<value_t>().allocate(n);
+  }
+
+  /**
+   * @brief Releases a buffer returned by allocate
+   *
+   * @param p the first element of the buffer
+   * @param n the number of elements it was allocated with
+   */
+  void deallocate(value_t *p, size_t n) noexcept {
+#if defined(MAP_ANONYMOUS)
+    if (n * sizeof(value_t) >= min_bytes) {
+      munmap(p, n * sizeof(value_t));
+      return;
+    }
+#endif
+    aligned_allocator<value_t>().deallocate(p, n);
+  }
+
+  /**
+   * @brief Default initializes an element, a trivial one is left untouched
+   *
+   * @param p the element
+   */
+  template <class U>
+  void construct(U *p) noexcept(
+      std::is_nothrow_default_constructible<U>::value) {
+    ::new (static_cast<void *>(p)) U;
+  }
+  template <class U, class... Args>
+  void construct(U *p, Args &&...args) {
+    ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+  }
+
+  template <class other_t>
+  bool operator==(first_touch_allocator<other_t> const &) const {
+    return true;
+  }
+  template <class other_t>
+  bool operator!=(first_touch_allocator<other_t> const &) const {
+    return false;
+  }
+};
+
+/**
+ * @brief A vector whose large buffers are placed page by page by the threads
+ * first writing to them
+ *
+ * @tparam value_t the type of the elements
+ */
+template <class value_t>
+using first_touch_vector = std::vector<value_t, first_touch_allocator<value_t>>;
+
+/**
+ * @brief Checks if a storage leaves the placement of its pages to the first
+ * thread writing them, see first_touch_allocator
+ *
+ * @tparam storage_t the storage type
+ */
+template <class storage_t>
+struct first_touch : std::false_type {};
+template <class value_t>
+struct first_touch<first_touch_vector<value_t>> : std::true_type {};
+
+/**
+ * @brief The NUMA node holding the page of an address, from get_mempolicy on
+ * Linux. Pages that were never touched are placed by the query itself.
+ *
+ * @param address any address of the page
+ * @return int the node, -1 when it can not be known
+ */
+inline int numa_node(void const *address) {
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+  // MPOL_F_NODE | MPOL_F_ADDR from <numaif.h>, which is not always installed.
+  constexpr unsigned long node_of_address = 1 | 2;
+  int node = -1;
+  if (syscall(SYS_get_mempolicy, &node, nullptr, 0UL,
+              const_cast<void *>(address), node_of_address) != 0)
+    return -1;
+  return node;
+#else
+  (void)address;
+  return -1;
+#endif
+}
+
+#if defined(MATRIX_HAS_MMAP)
+/**
+ * @brief A storage over the payload of a memory mapped file, see
+ * io::open_mapped. The mapping is released with the storage, pages are read
+ * from the file on first touch and written back by the kernel.
+ *
+ * @tparam value_t the type of the elements
+ */
+template <class value_t>
+class mapped {
+  void *_base = nullptr;
+  size_t _length = 0;
+  value_t *_data = nullptr;
+  size_t _size = 0;
+  bool _shared = false;
+
+ public:
+  /**
+   * @brief Construct a new empty mapped storage
+   *
+   */
+  mapped() = default;
+  /**
+   * @brief Takes ownership of a mapping
+   *
+   * @param base the address returned by mmap
+   * @param length the length of the mapping
+   * @param data the first element of the payload inside the mapping
+   * @param size the number of elements in the payload
+   * @param shared true when writes reach the file
+   */
+  mapped(void *base, size_t length, value_t *data, size_t size,
+         bool shared = false)
+      : _base(base), _length(length), _data(data), _size(size),
+        _shared(shared) {}
+  /**
+   * @brief Moves the mapping, other is left empty
+   *
+   * @param other the storage to move from
+   */
+  mapped(mapped &&other) noexcept
+      : _base(other._base),
+        _length(other._length),
+        _data(other._data),
+        _size(other._size),
+        _shared(other._shared) {
+    other._base = nullptr;
+    other._data = nullptr;
+    other._length = other._size = 0;
+  }
+  mapped(mapped const &) = delete;
+  mapped &operator=(mapped const &) = delete;
+  /**
+   * @brief Exchanges the mappings, the one of *this is released with other
+   *
+   * @param other the storage to move from
+   * @return mapped& the reference to *this
+   */
+  mapped &operator=(mapped &&other) noexcept {
+    std::swap(_base, other._base);
+    std::swap(_length, other._length);
+    std::swap(_data, other._data);
+    std::swap(_size, other._size);
+    std::swap(_shared, other._shared);
+    return *this;
+  }
+  ~mapped() {
+    if (_base != nullptr) munmap(_base, _length);
+  }
+  /**
+   * @brief Starts reading the pages of [first, last) from the file, or drops
+   * the pages lying wholly inside it. Pages of a private mapping are kept, they
+   * may hold the only copy of a write.
+   *
+   * @param first the first element of the range
+   * @param last one past the last element of the range
+   * @param a the hint
+   */
+  void advise(size_t first, size_t last, advice a) const {
+    if (first >= last) return;
+    std::uintptr_t page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+    auto begin = reinterpret_cast<std::uintptr_t>(_data + first);
+    auto end = reinterpret_cast<std::uintptr_t>(_data + last);
+    if (a == advice::will_need) {
+      begin -= begin % page;
+      madvise(reinterpret_cast<void *>(begin), end - begin, MADV_WILLNEED);
+    } else if (_shared) {
+      begin += (page - begin % page) % page;
+      end -= end % page;
+      if (begin < end)
+        madvise(reinterpret_cast<void *>(begin), end - begin, MADV_DONTNEED);
+    }
+  }
+  value_t &operator[](size_t i) { return _data[i]; }
+  value_t const &operator[](size_t i) const { return _data[i]; }
+  value_t *data() { return _data; }
+  value_t const *data() const { return _data; }
+  size_t size() const { return _size; }
+};
+
+/**
+ * @brief mapped storage is contiguous but can not be resized.
+ *
+ */
+template <class value_t>
+struct traits<mapped<value_t>> {
+  static constexpr bool contiguous = true;
+  static constexpr bool resizable = false;
+};
+#endif
+}  // namespace storage
+
+/**
+ * @brief This namespace holds the packet (SIMD register) abstraction used to
+ * evaluate expressions one vector instruction per operation. The width is
+ * chosen at compile time from the widest instruction set the translation unit
+ * is compiled for (-mavx512f, -mavx2/-mavx, -msse2). Types that cannot be
+ * vectorized, like std::complex, fall back to a packet of one element.
+ *
+ */
+namespace simd {
+
+#if defined(__AVX512F__)
+constexpr size_t register_bytes = 64;
+#elif defined(__AVX__)
+constexpr size_t register_bytes = 32;
+#elif defined(__SSE2__) || defined(__ARM_NEON) || defined(__ALTIVEC__)
+constexpr size_t register_bytes = 16;
+#else
+constexpr size_t register_bytes = 0;
+#endif
+
+/**
+ * @brief Describes the packet of value_t. The fallback is a packet of exactly
+ * one element which is the value itself.
+ *
+ * @tparam value_t the element type
+ */
+template <class value_t, class = void>
+struct packet_traits {
+  /**
+   * @brief the number of elements in one packet
+   *
+   */
+  static constexpr size_t size = 1;
+  /**
+   * @brief the type of the packet
+   *
+   */
+  using type = value_t;
+};
+
+#if defined(__GNUC__)
+/**
+ * @brief Packets of arithmetic types are GCC/Clang vector extension types
+ * which compile every operator down to one instruction of the target ISA.
+ *
+ * @tparam value_t the element type
+ */
+template <class value_t>
+struct packet_traits<
+    value_t, std::enable_if_t<std::is_arithmetic<value_t>::value &&
+                              !std::is_same<value_t, bool>::value &&
+                              (register_bytes > sizeof(value_t))>> {
+  static constexpr size_t size = register_bytes / sizeof(value_t);
+  typedef value_t type __attribute__((vector_size(register_bytes)));
+};
+#endif
+
+/**
+ * @brief The packet type of value_t
+ *
+ */
+template <class value_t>
+using packet_t = typename packet_traits<value_t>::type;
+
+/**
+ * @brief Loads one packet from a possibly unaligned address.
+ *
+ * @tparam value_t the element type
+ * @param from the address of the first element
+ * @return packet_t<value_t> the loaded packet
+ */
+template <class value_t>
+packet_t<value_t> load(value_t const *from) {
+  packet_t<value_t> p;
+  std::memcpy(&p, from, sizeof(p));
+  return p;
+}
+
+/**
+ * @brief Stores one packet to a possibly unaligned address.
+ *
+ * @tparam value_t the element type
+ * @param to the address of the first element
+ * @param p the packet to store
+ */
+template <class value_t>
+void store(value_t *to, packet_t<value_t> const &p) {
+  std::memcpy(to, &p, sizeof(p));
+}
+
+/**
+ * @brief Creates a packet with every element equal to v.
+ *
+ * @tparam value_t the element type
+ * @param v the value to broadcast
+ * @return packet_t<value_t> the packet
+ */
+template <class value_t>
+packet_t<value_t> set1(value_t const &v) {
+  value_t lanes[packet_traits<value_t>::size];
+  for (auto &lane : lanes) lane = v;
+  return load(lanes);
+}
+}  // namespace simd
+
+/**
+ * @brief An template Expression class for a node in AST of lazy evalution.
+ *
+ * @tparam E the type to create an expression into.
+ */
+template <typename E>
+class expression {
+ public:
+  /**
+   * @brief returns the expression at i
+   *
+   * @param i the index
+   * @return expression<E> the expression at that index.
+   */
+  auto get(size_t i) const {
+    return static_cast<E const &>(*this).get(i);  // East-Const
+  }
+  /**
+   * @brief returns the packet of values starting at flat index i. Only valid
+   * when E::packet_access is true.
+   *
+   * @param i the index of the first element of the packet
+   * @return the packet of simd::packet_traits<E::value_type>::size elements
+   */
+  auto get_packet(size_t i) const {
+    return static_cast<E const &>(*this).get_packet(i);
+  }
+  /**
+   * @brief returns the expression at row i and column j
+   *
+   * @param i the row index
+   * @param j the column index
+   * @return the value of the expression at that position.
+   */
+  auto get(size_t i, size_t j) const {
+    return static_cast<E const &>(*this).get(i, j);
+  }
+  /**
+   * @brief Get the dimension of expression object
+   *
+   * @return dimension the dimension of the expression.
+   */
+  auto get_dimension() const {
+    return static_cast<E const &>(*this).get_dimension();
+  }
+
+  /**
+   * @brief Get the format object
+   *
+   * @return the type of the format used in this matrix
+   */
+
+  auto get_format() const { return static_cast<E const &>(*this).get_format(); }
+};
+
+/**
+ * @brief Settings of the out of core evaluation. An assignment whose output
+ * spans more than chunk_bytes() is evaluated a chunk of whole rows (or columns
+ * in column major order) at a time. While a chunk is computed the pages of the
+ * next one are requested from the storage of the output and, when the tree
+ * shares its layout, of every operand, and the pages of the finished chunk are
+ * released. With memory mapped files the resident memory is bounded by a few
+ * chunks instead of the size of the matrices.
+ *
+ */
+struct streaming {
+  /**
+   * @brief The size of a chunk in bytes of the output, 64 MB by default. Zero
+   * evaluates every assignment in one pass.
+   *
+   * @return size_t the current setting
+   */
+  static size_t chunk_bytes() {
+    return _bytes().load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Overrides the size of a chunk from now on. Assignments already
+   * running keep their chunks.
+   *
+   * @param bytes the new size, 0 evaluates every assignment in one pass
+   */
+  static void set_chunk_bytes(size_t bytes) {
+    _bytes().store(bytes, std::memory_order_relaxed);
+  }
+
+ private:
+  /**
+   * @brief the setting, read by every assignment while others may set it
+   *
+   */
+  static std::atomic<size_t> &_bytes() {
+    static std::atomic<size_t> bytes{size_t(64) << 20};
+    return bytes;
+  }
+};
+
+/**
+ *
+ * @brief The template class of the matrix. It is final and implements
+ * Curiously Recurring Templates Pattern. The shape of a matrix only changes
+ * when a whole matrix is copied or moved into it, expressions must always
+ * match its dimension.
+ *
+ * @tparam value_t the type that this matrix will hold.
+ */
+template <typename value_t, class format_t = policy::RowMajorPolicy<value_t>,
+          class storage_t = std::vector<value_t>>
+class matrix final : public expression<matrix<value_t, format_t, storage_t>> {
+  dimension _dimen;
+  storage_t _elements;
+  format_t _format;
+
+  /**
+   * @brief Constructs the values in the container. If it is
+   *
+   */
+  void _construct_container() {
+    if constexpr (storage::traits<storage_t>::resizable) {
+      MATRIX_COUNT(allocations, _dimen.count() != 0);
+      MATRIX_COUNT(bytes_written, _dimen.count() * sizeof(value_t));
+    }
+    if constexpr (storage::first_touch<storage_t>::value) {
+      _elements = storage_t(_dimen.count());
+      value_t *data = _elements.data();
+      size_t line = _line();
+      _partitioned(0, _lines(), _dimen.count(), [&](size_t lo, size_t hi) {
+        std::fill(data + lo * line, data + hi * line, value_t());
+      });
+    } else if constexpr (storage::traits<storage_t>::resizable) {
+      _elements = storage_t(_dimen.count());
+    } else {
+      if (_dimen.count() != _elements.size()) {
+        throw std::logic_error(
+            std::string("Cannot Create a matrix out of provided array size. "
+                        "Array size must be ") +
+            std::to_string(_dimen.count()));
+      }
+    }
+  }
+
+  /**
+   * @brief The length of a line, a row in row major order and a column
+   * otherwise
+   *
+   */
+  size_t _line() const {
+    return format_t::is_row_major ? _dimen.col_dimen : _dimen.row_dimen;
+  }
+
+  /**
+   * @brief The number of lines, see _line
+   *
+   */
+  size_t _lines() const {
+    return _line() == 0 ? 0 : _dimen.count() / _line();
+  }
+
+  /**
+   * @brief Runs f(lo, hi) over the part of the lines [first, last) in each
+   * partition of the lines of this matrix, see execution::for_partitions. Any
+   * range of lines is thus always written by the thread owning it.
+   *
+   * @tparam F the type of the task
+   * @param first the first line
+   * @param last one past the last line
+   * @param work the work of the whole loop, see execution::parallel
+   * @param f the task
+   */
+  template <class F>
+  void _partitioned(size_t first, size_t last, size_t work, F const &f) {
+    execution::for_partitions(_lines(), work, [&](size_t lo, size_t hi) {
+      lo = std::max(lo, first);
+      hi = std::min(hi, last);
+      if (lo < hi) f(lo, hi);
+    });
+  }
+
+  /**
+   * @brief Computes the dimension of a container of rows
+   *
+   * @tparam rows_t the type of the container of rows
+   * @param rows the container of rows
+   * @return dimension the number of rows and the length of the first row
+   */
+  template <class rows_t>
+  static dimension _dimension_of(rows_t const &rows) {
+    if (rows.size() == 0) return dimension();
+    return dimension(rows.size(), std::begin(rows)->size());
+  }
+
+  /**
+   * @brief Checks that all rows have the same length then fills the storage
+   * straight from the rows in one pass, without any intermediate copy.
+   *
+   * @tparam rows_t the type of the container of rows
+   * @param rows the container of rows
+   */
+  template <class rows_t>
+  void _fill_rows(rows_t const &rows) {
+    for (auto &e : rows) {
+      if (e.size() != _dimen.col_dimen)
+        throw std::logic_error(
+            "Cannot create a matrix out of the provided rows. Length of each "
+            "row must be same");
+    }
+    _construct_container();
+    format_t::fill(_elements, rows);
+    MATRIX_COUNT(elements, _dimen.count());
+    MATRIX_COUNT(bytes_read, _dimen.count() * sizeof(value_t));
+    MATRIX_COUNT(bytes_written, _dimen.count() * sizeof(value_t));
+  }
+
+  /**
+   * @brief Evaluates expr and combines every element into this with op. When
+   * the whole expression tree supports packet access and shares this format
+   * and value type, the loop runs one packet at a time and only the tail is
+   * evaluated element by element. When the tree shares this format the flat
+   * loop needs no index conversion. Otherwise the output is walked tile by
+   * tile through get(i, j) so that no operand is strided by a full dimension.
+   * A tree holding a single matrix product among elementwise nodes is
+   * evaluated by the product kernel instead, which applies the rest of the
+   * tree to each finished element as it stores it, unless the product reads
+   * this matrix. Outputs larger than streaming::chunk_bytes() are evaluated
+   * in chunks of lines, see streaming, except first touch storage, which is
+   * never mapped and would leave every partition outside a chunk idle. A
+   * tree that is not pointwise, like a transpose, and reads this matrix is
+   * evaluated into a temporary first.
+   *
+   * @tparam E the expression template
+   * @tparam Op the combining functor, called as op(old, new) with either two
+   * values or two packets
+   * @param expr the expression to evaluate
+   * @param op the functor producing the value to store
+   */
+  template <typename E, typename Op>
+  void _assign(E const &expr, Op op) {
+    if constexpr (!util::pointwise<E>::value) {
+      if (_read_by(expr)) {
+        matrix<value_t, format_t> copy(expr);
+        _assign(copy, op);
+        return;
+      }
+    }
+    MATRIX_COUNT(evaluations, 1);
+    MATRIX_COUNT(elements, _dimen.count());
+    MATRIX_COUNT(bytes_written, _dimen.count() * sizeof(value_t));
+    MATRIX_COUNT(bytes_read, _dimen.count() * util::bytes_read<E>::value);
+    if constexpr (!std::is_same<Op, _replace>::value)
+      MATRIX_COUNT(bytes_read, _dimen.count() * sizeof(value_t));
+    MATRIX_COUNT(layout_conversions,
+                 !(E::uniform_layout &&
+                   util::same_layout<typename E::format_type, format_t>));
+    if constexpr (util::fused_products<E>::value == 1 &&
+                  storage::traits<storage_t>::contiguous) {
+      value_t const *first = _elements.data();
+      auto const &product = expr.fused_product();
+      if (!util::references(product, first, first + _dimen.count())) {
+        util::prepared<E> prepared(expr, true);
+        product.evaluate([&](size_t i, size_t j, auto const &acc) {
+          auto &out = format_t::ordering(_elements, i, j, _dimen);
+          out = op(out, expr.get_fused(i, j, acc));
+        });
+        return;
+      }
+    }
+    util::prepared<E> prepared(expr);
+    size_t line = _line(), lines = _lines();
+    size_t bytes = streaming::chunk_bytes();
+    if (storage::first_touch<storage_t>::value || bytes == 0 ||
+        _dimen.count() * sizeof(value_t) <= bytes) {
+      _assign_lines(expr, op, 0, lines);
+      return;
+    }
+    size_t step = std::max<size_t>(1, bytes / (line * sizeof(value_t)));
+    _advise(expr, 0, std::min(lines, step) * line, storage::advice::will_need);
+    for (size_t first = 0; first < lines; first += step) {
+      size_t last = std::min(lines, first + step);
+      _advise(expr, last * line, std::min(lines, last + step) * line,
+              storage::advice::will_need);
+      _assign_lines(expr, op, first, last);
+      _advise(expr, first * line, last * line, storage::advice::done);
+    }
+  }
+
+  /**
+   * @brief Checks if evaluating expr reads the elements of this matrix.
+   * Storage that is not contiguous is always read.
+   *
+   * @tparam E the expression template
+   * @param expr the expression about to be assigned
+   * @return true if expr may read this matrix
+   */
+  template <typename E>
+  bool _read_by(E const &expr) const {
+    if constexpr (storage::traits<storage_t>::contiguous) {
+      value_t const *first = _elements.data();
+      return util::references(expr, first, first + _dimen.count());
+    } else {
+      return true;
+    }
+  }
+
+  /**
+   * @brief Evaluates the lines [first, last) of the output, rows in row major
+   * order and columns otherwise, see _assign. A first touch storage is
+   * evaluated by the threads owning its lines, see _partitioned.
+   *
+   * @tparam E the expression template
+   * @tparam Op the combining functor
+   * @param expr the expression to evaluate
+   * @param op the functor producing the value to store
+   * @param first the first line
+   * @param last one past the last line
+   * @param split false to stay on the calling thread
+   */
+  template <typename E, typename Op>
+  void _assign_lines(E const &expr, Op op, size_t first, size_t last,
+                     bool split = true) {
+    constexpr bool row_major = format_t::is_row_major;
+    size_t cost = split ? util::cost<E>::value : 0;
+    if constexpr (storage::first_touch<storage_t>::value) {
+      if (split) {
+        _partitioned(first, last, (last - first) * _line() * cost,
+                     [&](size_t lo, size_t hi) {
+                       _assign_lines(expr, op, lo, hi, false);
+                     });
+        return;
+      }
+    }
+    if constexpr (E::uniform_layout &&
+                  util::same_layout<typename E::format_type, format_t>) {
+      size_t line = row_major ? _dimen.col_dimen : _dimen.row_dimen;
+      size_t begin = first * line, end = last * line;
+      constexpr bool packets =
+          E::packet_access && packet_access &&
+          std::is_same<typename E::value_type, value_t>::value;
+      constexpr size_t width = packets ? simd::packet_traits<value_t>::size : 1;
+      size_t work = (end - begin) * cost;
+      execution::for_ranges(
+          end - begin, work,
+          [&](size_t lo, size_t hi) {
+            size_t i = begin + lo;
+            if constexpr (packets) {
+              value_t *out = _elements.data();
+              for (; i + width <= begin + hi; i += width)
+                simd::store(out + i, op(simd::load(out + i),
+                                        expr.get_packet(i)));
+            }
+            for (; i < begin + hi; i++)
+              _elements[i] = op(_elements[i], expr.get(i));
+          },
+          width);
+    } else {
+      dimension chunk = row_major ? dimension(last - first, _dimen.col_dimen)
+                                  : dimension(_dimen.row_dimen, last - first);
+      util::for_each_tiled<row_major>(chunk, [&](size_t i, size_t j) {
+        if constexpr (row_major)
+          i += first;
+        else
+          j += first;
+        auto &out = format_t::ordering(_elements, i, j, _dimen);
+        out = op(out, expr.get(i, j));
+      }, cost);
+    }
+  }
+
+  /**
+   * @brief Passes an access hint for the flat range [first, last) to the
+   * storage of this matrix and, when expr shares its layout, to the leaves of
+   * expr.
+   *
+   * @tparam E the expression template
+   * @param expr the expression being evaluated
+   * @param first the first flat index of the range
+   * @param last one past the last flat index of the range
+   * @param a the hint
+   */
+  template <typename E>
+  void _advise(E const &expr, size_t first, size_t last,
+               storage::advice a) const {
+    if (first >= last) return;
+    util::advise(_elements, first, last, a);
+    if constexpr (E::uniform_layout &&
+                  util::same_layout<typename E::format_type, format_t>)
+      util::advise(expr, first, last, a);
+  }
+
+  /**
+   * @brief Counts a copy of the elements of another matrix into this one, see
+   * instrument
+   *
+   */
+  void _count_copy() const {
+    if constexpr (storage::traits<storage_t>::resizable)
+      MATRIX_COUNT(allocations, _dimen.count() != 0);
+    MATRIX_COUNT(elements, _dimen.count());
+    MATRIX_COUNT(bytes_read, _dimen.count() * sizeof(value_t));
+    MATRIX_COUNT(bytes_written, _dimen.count() * sizeof(value_t));
+  }
+
+  /**
+   * @brief Functor that discards the old value and keeps the new one.
+   *
+   */
+  struct _replace {
+    template <class T, class U>
+    auto operator()(T const &, U const &u) const {
+      return u;
+    }
+  };
+
+ public:
+  /**
+   * @brief the type of the elements held by this matrix
+   *
+   */
+  using value_type = value_t;
+
+  /**
+   * @brief the format policy of this matrix
+   *
+   */
+  using format_type = format_t;
+
+  /**
+   * @brief a matrix is a leaf, its flat indices are always in its own format
+   *
+   */
+  static constexpr bool uniform_layout = true;
+
+  /**
+   * @brief a matrix reads its element (i, j) at (i, j)
+   *
+   */
+  static constexpr bool pointwise = true;
+
+  /**
+   * @brief true when the elements are contiguous and value_t has a packet
+   * wider than one element.
+   *
+   */
+  static constexpr bool packet_access =
+      storage::traits<storage_t>::contiguous &&
+      (simd::packet_traits<value_t>::size > 1);
+
+  /**
+   * @brief returns element at i, j position in the matrix.
+   *
+   * @param i the row index
+   * @param j the column index
+   * @return dtype the element at that position
+   */
+  auto get(size_t i, size_t j) const {
+    return format_t::ordering(_elements, i, j, _dimen);
+  }
+  /**
+   * @brief returns element at i, j position in the matrix by reference. It can
+   * be used to assign values to i,j as well.
+   *
+   * @param i the row index
+   * @param j the column index
+   * @return dtype the element at that position
+   */
+  auto &get(size_t i, size_t j) {
+    return format_t::ordering(_elements, i, j, _dimen);
+  }
+  /**
+   * @brief Returns the value from the ith position in flat array
+   *
+   * @param i the index to look for
+   * @return dtype the value returned
+   */
+  auto get(size_t i) const { return _elements[i]; }
+
+  /**
+   * @brief Returns the value from the ith position in flat array by reference
+   *
+   * @param i the index to look for
+   * @return dtype the value returned by reference
+   */
+  auto &get(size_t i) { return _elements[i]; }
+
+  /**
+   * @brief Returns the packet of values starting at the ith position in flat
+   * array.
+   *
+   * @param i the index of the first element of the packet
+   * @return simd::packet_t<value_t> the loaded packet
+   */
+  auto get_packet(size_t i) const { return simd::load(_elements.data() + i); }
+
+  /**
+   * @brief Checks if the elements of this matrix overlap [first, last).
+   * Storage that is not contiguous always overlaps.
+   *
+   * @param first the first byte of the range
+   * @param last one past the last byte of the range
+   * @return true if they overlap
+   */
+  bool references(void const *first, void const *last) const {
+    if constexpr (storage::traits<storage_t>::contiguous) {
+      if (_dimen.count() == 0) return false;
+      void const *begin = _elements.data();
+      void const *end = _elements.data() + _dimen.count();
+      std::less<void const *> before;
+      return before(first, end) && before(begin, last);
+    } else {
+      return true;
+    }
+  }
+
+  /**
+   * @brief Passes an access hint for the flat range [first, last) to the
+   * storage, which may ignore it.
+   *
+   * @param first the first flat index of the range
+   * @param last one past the last flat index of the range
+   * @param a the hint
+   */
+  void advise(size_t first, size_t last, storage::advice a) const {
+    util::advise(_elements, first, last, a);
+  }
+
+  /**
+   * @brief Get the dimension of the matrix
+   *
+   * @return dimension the dimension of the matrix.
+   */
+  auto get_dimension() const { return _dimen; }
+
+  /**
+   * @brief Get the format policy object
+   *
+   * @return the format policy object
+   */
+  auto get_format() const { return _format; }
+
+  /**
+   * @brief Construct a new lazy matrix object
+   *
+   * @param rc the rows in the matrix
+   * @param cc the columns in the matrix
+   */
+  matrix(size_t rc, size_t cc) : _dimen(rc, cc) {
+    MATRIX_PROBE("constructor");
+    _construct_container();
+  }
+  /**
+   * @brief Construct a new matrix object from an initializer list.
+   *
+   * @param elem the initializer list of initialiazer lists
+   */
+  // cppcheck-suppress noExplicitConstructor
+  matrix(std::initializer_list<std::initializer_list<value_t>> elem)
+      : _dimen(_dimension_of(elem)) {
+    MATRIX_PROBE("constructor");
+    _fill_rows(elem);
+  }
+  /**
+   * @brief Construct a new lazy matrix object from vectors
+   *
+   * @param elem vectors of vectors of elements.
+   */
+  // cppcheck-suppress noExplicitConstructor
+  matrix(std::vector<std::vector<value_t>> const &elem)
+      : _dimen(_dimension_of(elem)) {
+    MATRIX_PROBE("constructor");
+    _fill_rows(elem);
+  }
+  /**
+   * @brief Construct a new matrix object from any container of rows, e.g. a
+   * std::deque of std::array. The elements are copied once, straight into the
+   * storage.
+   *
+   * @tparam rows_t the type of the container of rows
+   * @param elem the container of rows
+   */
+  template <class rows_t,
+            class = std::enable_if_t<util::is_rows<rows_t, value_t>::value>>
+  explicit matrix(rows_t const &elem) : _dimen(_dimension_of(elem)) {
+    MATRIX_PROBE("constructor");
+    _fill_rows(elem);
+  }
+  /**
+   * @brief Construct a new matrix object that adopts an already filled flat
+   * storage without copying it. The elements must be laid out by format_t.
+   *
+   * @param rc the rows in the matrix
+   * @param cc the columns in the matrix
+   * @param elements the storage holding exactly rc * cc elements
+   */
+  matrix(size_t rc, size_t cc, storage_t &&elements)
+      : _dimen(rc, cc), _elements(std::move(elements)) {
+    if (_dimen.count() != _elements.size())
+      throw std::logic_error(
+          std::string("Cannot adopt the provided storage. Its size must be ") +
+          std::to_string(_dimen.count()));
+  }
+  /**
+   * @brief Construct a new matrix object over a buffer owned elsewhere, e.g.
+   * with storage::external. Nothing is copied, the buffer must outlive the
+   * matrix and be laid out by format_t.
+   *
+   * @param data the first element of the buffer
+   * @param rc the rows in the matrix
+   * @param cc the columns in the matrix
+   */
+  template <class S = storage_t,
+            class = std::enable_if_t<
+                std::is_constructible<S, value_t *, size_t>::value>>
+  matrix(value_t *data, size_t rc, size_t cc)
+      : matrix(rc, cc, storage_t(data, rc * cc)) {}
+
+  /**
+   * @brief Construct a new matrix object from an expression type. The
+   * Expression will be evaluated to initialize the new variable.
+   *
+   * @tparam E the expression template paramater
+   * @param expr the expression to create the matrix from
+   */
+
+  template <typename E>
+  matrix(expression<E> const &expr) : _dimen(expr.get_dimension()) {
+    MATRIX_PROBE("constructor");
+    _construct_container();
+    _assign(static_cast<E const &>(expr), _replace());
+  }
+
+  /**
+   * @brief Construct a new matrix object as a copy of other. Matrices over
+   * storage that cannot be copied, like storage::external, cannot be copied.
+   *
+   * @param other the matrix to copy
+   */
+#if defined(MATRIX_INSTRUMENT)
+  matrix(matrix const &other)
+      : _dimen(other._dimen),
+        _elements(other._elements),
+        _format(other._format) {
+    MATRIX_PROBE("constructor");
+    _count_copy();
+  }
+#else
+  matrix(matrix const &other) = default;
+#endif
+
+  /**
+   * @brief Construct a new matrix object by stealing the elements of other in
+   * O(1). other is left as an empty 0 x 0 matrix. Matrices of another format
+   * are converted through the expression constructor instead.
+   *
+   * @param other the matrix to move from
+   */
+  matrix(matrix &&other) noexcept
+      : _dimen(other._dimen),
+        _elements(std::move(other._elements)),
+        _format(other._format) {
+    other._dimen = dimension();
+  }
+
+  /**
+   * @brief Construct a new matrix object from an rvalue expression
+   *
+   * @tparam E the expression template
+   * @param expr the actual expression
+   */
+
+  template <typename E>
+  matrix(expression<E> &&expr) : _dimen(expr.get_dimension()) {
+    MATRIX_PROBE("constructor");
+    _construct_container();
+    _assign(static_cast<E const &>(expr), _replace());
+  }
+
+  /**
+   * @brief Assignment from an expression will cause the expression to be
+   * evaluated.
+   *
+   * @tparam E the expression template type, should be deduced by compiler.
+   * @param expr the expression from which to evaluate.
+   * @return lazy_matrix& the reference to *this
+   */
+
+  template <typename E>
+  auto &operator=(expression<E> const &expr) {
+    MATRIX_PROBE("operator=");
+    util::assert_same_dimensions(*this, expr);
+    _assign(static_cast<E const &>(expr), _replace());
+    return *this;
+  }
+
+  /**
+   * @brief Assignment from an expression will cause the expression to be
+   * evaluated. It evaluates the lvalue and swaps with this
+   *
+   * @tparam E the expression template type, should be deduced by compiler.
+   * @param expr the expression from which to evaluate.
+   * @return lazy_matrix& the reference to *this
+   */
+
+  template <typename E>
+  auto &operator=(expression<E> &&expr) {
+    MATRIX_PROBE("operator=");
+    util::assert_same_dimensions(*this, expr);
+    _assign(static_cast<E const &>(expr), _replace());
+    return *this;
+  }
+
+  /**
+   * @brief Assignment from other Matrix Variable. This takes the dimension of
+   * other, the storage is reused when it is large enough. Storage that cannot
+   * be resized, like storage::external, must have the dimension of other and
+   * receives a copy of its elements.
+   *
+   * @param other the value with which to assign this variable.
+   * @return lazy_matrix& the reference to *this
+   */
+  auto &operator=(matrix const &other) {
+    MATRIX_PROBE("operator=");
+    if constexpr (!storage::traits<storage_t>::resizable)
+      util::assert_same_dimensions(*this, other);
+    if (this != &other) {
+      _dimen = other._dimen;
+      _elements = other._elements;
+      _count_copy();
+    }
+    return *this;
+  }
+
+  /**
+   * @brief Move assignment from other Matrix Variable. Steals the elements
+   * and the dimension of other in O(1) and leaves other as an empty 0 x 0
+   * matrix.
+   *
+   * @param other the value to move into this variable.
+   * @return lazy_matrix& the reference to *this
+   */
+  auto &operator=(matrix &&other) noexcept {
+    if (this != &other) {
+      _dimen = other._dimen;
+      _elements = std::move(other._elements);
+      other._dimen = dimension();
+    }
+    return *this;
+  }
+
+  /**
+   * @brief Add and Assignment overload with expression. It will cause
+   * expression to be evaluated
+   *
+   * @tparam E the expression template paramater
+   * @param expr the expression with which we will evaluate and assign to *this
+   * @return matrix& the reference to *this
+   */
+
+  template <typename E>
+  matrix &operator+=(expression<E> const &expr) {
+    MATRIX_PROBE("operator+=");
+    util::assert_same_dimensions(*this, expr);
+    _assign(static_cast<E const &>(expr),
+            [](auto const &a, auto const &b) { return a + b; });
+    return *this;
+  }
+
+  /**
+   * @brief Subtract and Assignment overload with expression. It will cause
+   * expression to be evaluated
+   *
+   * @tparam E the expression template paramater
+   * @param expr the expression with which we will evaluate and assign to *this
+   * @return matrix& the reference to *this
+   */
+
+  template <typename E>
+  matrix &operator-=(expression<E> const &expr) {
+    MATRIX_PROBE("operator-=");
+    util::assert_same_dimensions(*this, expr);
+    _assign(static_cast<E const &>(expr),
+            [](auto const &a, auto const &b) { return a - b; });
+    return *this;
+  }
+
+  /**
+   * @brief Multiply and Assignment overload with expression. It will cause
+   * expression to be evaluated
+   *
+   * @tparam E the expression template paramater
+   * @param expr the expression with which we will evaluate and assign to *this
+   * @return matrix& the reference to *this
+   */
+
+  template <typename E>
+  matrix &operator*=(expression<E> const &expr) {
+    MATRIX_PROBE("operator*=");
+    util::assert_same_dimensions(*this, expr);
+    _assign(static_cast<E const &>(expr),
+            [](auto const &a, auto const &b) { return a * b; });
+    return *this;
+  }
+
+  /**
+   * @brief Division and Assignment overload with expression. It will cause
+   * expression to be evaluated
+   *
+   * @tparam E the expression template paramater
+   * @param expr the expression with which we will evaluate and assign to *this
+   * @return matrix& the reference to *this
+   */
+
+  template <typename E>
+  matrix &operator/=(expression<E> const &expr) {
+    MATRIX_PROBE("operator/=");
+    util::assert_same_dimensions(*this, expr);
+    _assign(static_cast<E const &>(expr),
+            [](auto const &a, auto const &b) { return a / b; });
+    return *this;
+  }
+
+  /**
+   * @brief Scaler Addition to all the elements in the matrix. Type
+   * must have an overload with + operator to dtype of matrix.
+   *
+   * @tparam T the type to add.
+   * @param t the value to add to all element.
+   */
+
+  template <typename T>
+  void scalar_add(T t) {
+    execution::for_ranges(
+        _dimen.count(), _dimen.count(), [&](size_t first, size_t last) {
+          for (size_t a = first; a < last; a++) _elements[a] += t;
+        });
+  }
+
+  /**
+   * @brief Scaler subtraction to all the elements in the matrix.
+   * Type must have an overload with - operator to dtype of matrix.
+   *
+   * @tparam T the type to subtract.
+   * @param t the value to subtracted from all element.
+   */
+
+  template <typename T>
+  void scalar_sub(T t) {
+    execution::for_ranges(
+        _dimen.count(), _dimen.count(), [&](size_t first, size_t last) {
+          for (size_t a = first; a < last; a++) _elements[a] -= t;
+        });
+  }
+
+  /**
+   * @brief Scaler Multiplication to all the elements in the
+   * matrix. Type must have an overload with * operator to dtype of matrix.
+   *
+   * @tparam T the type to multiply.
+   * @param t the value to multiply to all element.
+   */
+
+  template <typename T>
+  void scalar_mul(T t) {
+    execution::for_ranges(
+        _dimen.count(), _dimen.count(), [&](size_t first, size_t last) {
+          for (size_t a = first; a < last; a++) _elements[a] *= t;
+        });
+  }
+
+  /**
+   * @brief Scaler Division of all the elements in the matrix. Type must have
+   * an overload with / operator to dtype of matrix.
+   *
+   * @tparam T the type to divide by.
+   * @param t the value to divide all element by.
+   */
+
+  template <typename T>
+  void scalar_div(T t) {
+    execution::for_ranges(
+        _dimen.count(), _dimen.count(), [&](size_t first, size_t last) {
+          for (size_t a = first; a < last; a++) _elements[a] /= t;
+        });
+  }
+
+  /**
+   * @brief Prints the content of a matrix to the stream. Default to std::cout
+   *
+   * @param stream the stream to print the values.
+   */
+
+  void view(std::ostream &stream = std::cout) {
+    auto min_row = (10 > _dimen.row_dimen ? _dimen.row_dimen : 10);
+    auto min_col = (10 > _dimen.col_dimen ? _dimen.col_dimen : 10);
+    for (size_t i = 0; i < min_row; i++) {
+      for (size_t j = 0; j < min_col; j++) stream << get(i, j) << " ";
+      stream << "\n";
+    }
+  }
+};
+
+/**
+ * @brief This operator will check if the expression and the matrix have same
+ * value. It will cause the expression to be evalauted.
+ *
+ * @tparam E the template parameter of expression
+ * @param expr the expresssion type to evaluate
+ * @return true if the expresssion's evaluated value is same as this
+ * @return false otherwise
+ */
+
+/**
+ * @brief A matrix whose dimension is known at compile time, for the many small
+ * matrices of geometry code. The elements live inline in a std::array, so it
+ * never allocates, and every loop over them is unrolled at compile time and
+ * runs on the calling thread. It is an expression like matrix: it can be an
+ * operand of any node, and any expression of the same dimension can be
+ * assigned to it. The product of two fixed matrices is a fixed matrix, see
+ * operator|.
+ *
+ * @tparam value_t the type of the elements
+ * @tparam Rows the rows in the matrix
+ * @tparam Cols the columns in the matrix
+ * @tparam format_t the layout of the elements
+ */
+template <typename value_t, size_t Rows, size_t Cols,
+          class format_t = policy::RowMajorPolicy<value_t>>
+class fixed_matrix final
+    : public expression<fixed_matrix<value_t, Rows, Cols, format_t>> {
+  std::array<value_t, Rows * Cols> _elements{};
+
+  /**
+   * @brief the flat index of row i and column j in format_t
+   *
+   */
+  static constexpr size_t _index(size_t i, size_t j) {
+    return format_t::is_row_major ? i * Cols + j : j * Rows + i;
+  }
+
+  /**
+   * @brief Evaluates expr and combines every element into this with op, one
+   * statement per element. Trees sharing this layout are read by flat index.
+   * A tree that is not pointwise and reads this matrix is evaluated into a
+   * temporary first.
+   *
+   * @tparam E the expression template
+   * @tparam Op the combining functor, called as op(old, new)
+   * @tparam I the flat indices of the elements
+   * @param expr the expression to evaluate
+   * @param op the functor producing the value to store
+   */
+  template <typename E, typename Op, size_t... I>
+  void _assign(E const &expr, Op op, std::index_sequence<I...>) {
+    if constexpr (!util::pointwise<E>::value) {
+      if (util::references(expr, _elements.data(),
+                           _elements.data() + Rows * Cols)) {
+        fixed_matrix copy(expr);
+        _assign(copy, op, std::index_sequence<I...>());
+        return;
+      }
+    }
+    util::prepared<E> prepared(expr);
+    if constexpr (E::uniform_layout &&
+                  util::same_layout<typename E::format_type, format_t>) {
+      ((_elements[I] = op(_elements[I], expr.get(I))), ...);
+    } else {
+      constexpr size_t line = format_t::is_row_major ? Cols : Rows;
+      if constexpr (format_t::is_row_major)
+        ((_elements[I] = op(_elements[I], expr.get(I / line, I % line))),
+         ...);
+      else
+        ((_elements[I] = op(_elements[I], expr.get(I % line, I / line))),
+         ...);
+    }
+  }
+
+  /**
+   * @brief Checks the dimension of expr, then evaluates it, see _assign.
+   *
+   */
+  template <typename E, typename Op>
+  void _assign(expression<E> const &expr, Op op) {
+    util::assert_same_dimensions(*this, expr);
+    _assign(static_cast<E const &>(expr), op,
+            std::make_index_sequence<Rows * Cols>());
+  }
+
+ public:
+  /**
+   * @brief the type of the elements held by this matrix
+   *
+   */
+  using value_type = value_t;
+
+  /**
+   * @brief the format policy of this matrix
+   *
+   */
+  using format_type = format_t;
+
+  /**
+   * @brief a fixed matrix is a leaf, its flat indices are in its own format
+   *
+   */
+  static constexpr bool uniform_layout = true;
+
+  /**
+   * @brief a fixed matrix reads its element (i, j) at (i, j)
+   *
+   */
+  static constexpr bool pointwise = true;
+
+  /**
+   * @brief true when value_t has a packet wider than one element
+   *
+   */
+  static constexpr bool packet_access =
+      simd::packet_traits<value_t>::size > 1;
+
+  /**
+   * @brief the dimension of every fixed matrix of this type
+   *
+   */
+  static constexpr dimension extent = dimension(Rows, Cols);
+
+  /**
+   * @brief Construct a new fixed matrix with every element value initialized
+   *
+   */
+  constexpr fixed_matrix() = default;
+
+  /**
+   * @brief Construct a new fixed matrix object from rows of elements
+   *
+   * @param elem the rows, exactly Rows of exactly Cols elements each
+   */
+  // cppcheck-suppress noExplicitConstructor
+  fixed_matrix(std::initializer_list<std::initializer_list<value_t>> elem) {
+    if (elem.size() != Rows)
+      throw std::logic_error(
+          "Cannot create a fixed matrix out of the provided rows. There must "
+          "be " +
+          std::to_string(Rows) + " rows");
+    size_t i = 0;
+    for (auto &row : elem) {
+      if (row.size() != Cols)
+        throw std::logic_error(
+            "Cannot create a fixed matrix out of the provided rows. Length of "
+            "each row must be " +
+            std::to_string(Cols));
+      size_t j = 0;
+      for (auto &e : row) _elements[_index(i, j++)] = e;
+      i++;
+    }
+  }
+
+  /**
+   * @brief Construct a new fixed matrix object by evaluating an expression of
+   * the same dimension
+   *
+   * @tparam E the type of the expression
+   * @param expr the expression to evaluate
+   */
+  template <typename E>
+  // cppcheck-suppress noExplicitConstructor
+  fixed_matrix(expression<E> const &expr) {
+    _assign(expr, [](auto const &, auto const &b) { return b; });
+  }
+
+  /**
+   * @brief Evaluates an expression of the same dimension into this
+   *
+   * @tparam E the type of the expression
+   * @param expr the expression to evaluate
+   * @return fixed_matrix& the reference to *this
+   */
+  template <typename E>
+  fixed_matrix &operator=(expression<E> const &expr) {
+    _assign(expr, [](auto const &, auto const &b) { return b; });
+    return *this;
+  }
+
+  /**
+   * @brief Adds an expression of the same dimension into this
+   *
+   * @tparam E the type of the expression
+   * @param expr the expression to add
+   * @return fixed_matrix& the reference to *this
+   */
+  template <typename E>
+  fixed_matrix &operator+=(expression<E> const &expr) {
+    _assign(expr, [](auto const &a, auto const &b) { return a + b; });
+    return *this;
+  }
+
+  /**
+   * @brief Subtracts an expression of the same dimension from this
+   *
+   * @tparam E the type of the expression
+   * @param expr the expression to subtract
+   * @return fixed_matrix& the reference to *this
+   */
+  template <typename E>
+  fixed_matrix &operator-=(expression<E> const &expr) {
+    _assign(expr, [](auto const &a, auto const &b) { return a - b; });
+    return *this;
+  }
+
+  /**
+   * @brief Multiplies this elementwise by an expression of the same dimension
+   *
+   * @tparam E the type of the expression
+   * @param expr the expression to multiply by
+   * @return fixed_matrix& the reference to *this
+   */
+  template <typename E>
+  fixed_matrix &operator*=(expression<E> const &expr) {
+    _assign(expr, [](auto const &a, auto const &b) { return a * b; });
+    return *this;
+  }
+
+  /**
+   * @brief Divides this elementwise by an expression of the same dimension
+   *
+   * @tparam E the type of the expression
+   * @param expr the expression to divide by
+   * @return fixed_matrix& the reference to *this
+   */
+  template <typename E>
+  fixed_matrix &operator/=(expression<E> const &expr) {
+    _assign(expr, [](auto const &a, auto const &b) { return a / b; });
+    return *this;
+  }
+
+  /**
+   * @brief returns element at i, j position in the matrix.
+   *
+   * @param i the row index
+   * @param j the column index
+   * @return value_t the element at that position
+   */
+  constexpr value_t get(size_t i, size_t j) const {
+    return _elements[_index(i, j)];
+  }
+  /**
+   * @brief returns element at i, j position in the matrix by reference.
+   *
+   * @param i the row index
+   * @param j the column index
+   * @return value_t& the element at that position
+   */
+  constexpr value_t &get(size_t i, size_t j) { return _elements[_index(i, j)]; }
+  /**
+   * @brief Returns the value from the ith position in flat array
+   *
+   * @param i the index to look for
+   * @return value_t the value returned
+   */
+  constexpr value_t get(size_t i) const { return _elements[i]; }
+  /**
+   * @brief Returns the value from the ith position in flat array by reference
+   *
+   * @param i the index to look for
+   * @return value_t& the value returned by reference
+   */
+  constexpr value_t &get(size_t i) { return _elements[i]; }
+
+  /**
+   * @brief Returns the packet of values starting at the ith position in flat
+   * array.
+   *
+   * @param i the index of the first element of the packet
+   * @return simd::packet_t<value_t> the loaded packet
+   */
+  auto get_packet(size_t i) const { return simd::load(_elements.data() + i); }
+
+  /**
+   * @brief Checks if the elements of this matrix overlap [first, last)
+   *
+   * @param first the first byte of the range
+   * @param last one past the last byte of the range
+   * @return true if they overlap
+   */
+  bool references(void const *first, void const *last) const {
+    if (Rows * Cols == 0) return false;
+    void const *begin = _elements.data();
+    void const *end = _elements.data() + Rows * Cols;
+    std::less<void const *> before;
+    return before(first, end) && before(begin, last);
+  }
+
+  /**
+   * @brief Get the dimension of the matrix
+   *
+   * @return dimension the dimension of the matrix.
+   */
+  constexpr dimension get_dimension() const { return extent; }
+
+  /**
+   * @brief Get the format policy object
+   *
+   * @return the format policy object
+   */
+  constexpr format_t get_format() const { return format_t(); }
+};
+
+/**
+ * @brief The == (equality) operator overload. Checks lexpr is equal to expr
+ *
+ * @tparam E1 the left expression template
+ * @tparam E2 the right expression template
+ * @param lexpr the left side expression
+ * @param expr the right side expression
+ * @return true if they are same
+ * @return false otherwise
+ */
+template <typename E1, typename E2>
+bool operator==(expression<E1> const &lexpr, expression<E2> const &expr) {
+  util::assert_same_dimensions(lexpr, expr);
+  E1 const &l = static_cast<E1 const &>(lexpr);
+  E2 const &r = static_cast<E2 const &>(expr);
+  util::prepared<E1> prepared_l(l);
+  util::prepared<E2> prepared_r(r);
+  dimension dimen = l.get_dimension();
+  if constexpr (E1::uniform_layout && E2::uniform_layout &&
+                util::same_layout<typename E1::format_type,
+                                  typename E2::format_type>) {
+    for (size_t a = 0; a < dimen.count(); a++)
+      if (l.get(a) != r.get(a)) return false;
+  } else {
+    for (size_t i = 0; i < dimen.row_dimen; i++)
+      for (size_t j = 0; j < dimen.col_dimen; j++)
+        if (l.get(i, j) != r.get(i, j)) return false;
+  }
+  return true;
+}
+
+/**
+ * @brief This namespace holds the elementwise operations of binary_expr. Each
+ * one applies to two values, or to two packets of the same type.
+ *
+ */
+namespace op {
+/**
+ * @brief Functor that adds two values or two packets.
+ *
+ */
+struct plus {
+  template <class T, class U>
+  auto operator()(T const &a, U const &b) const {
+    return a + b;
+  }
+};
+
+/**
+ * @brief Functor that subtracts two values or two packets.
+ *
+ */
+struct minus {
+  template <class T, class U>
+  auto operator()(T const &a, U const &b) const {
+    return a - b;
+  }
+};
+
+/**
+ * @brief Functor that multiplies two values or two packets.
+ *
+ */
+struct multiplies {
+  template <class T, class U>
+  auto operator()(T const &a, U const &b) const {
+    return a * b;
+  }
+};
+
+/**
+ * @brief Functor that divides two values or two packets.
+ *
+ */
+struct divides {
+  template <class T, class U>
+  auto operator()(T const &a, U const &b) const {
+    return a / b;
+  }
+};
+}  // namespace op
+
+/**
+ * @brief Constructs a representation of node for an elementwise operation in
+ * the Abstract Syntax Tree
+ *
+ * @tparam E1 the first operand type
+ * @tparam E2 the second operand type
+ * @tparam Op the operation, see namespace op
+ */
+template <typename E1, typename E2, typename Op>
+class binary_expr : public expression<binary_expr<E1, E2, Op>> {
+  util::operand_t<E1> _u;
+  util::operand_t<E2> _v;
+
+ public:
+  /**
+   * @brief the type of the elements produced by this node
+   *
+   */
+  using value_type = std::decay_t<decltype(
+      Op()(std::declval<E1 const &>().get(0),
+           std::declval<E2 const &>().get(0)))>;
+
+  /**
+   * @brief the format policy of this node, which is the one of the first
+   * operand
+   *
+   */
+  using format_type = typename E1::format_type;
+
+  /**
+   * @brief true when every leaf below this node shares one layout so that a
+   * flat index means the same element in all of them.
+   *
+   */
+  static constexpr bool uniform_layout =
+      E1::uniform_layout && E2::uniform_layout &&
+      util::same_layout<typename E1::format_type, typename E2::format_type>;
+
+  /**
+   * @brief true when both operands support packet access with the same value
+   * type and layout so that packets of both line up element by element, and
+   * the operation does not promote that type.
+   *
+   */
+  static constexpr bool packet_access =
+      uniform_layout && E1::packet_access && E2::packet_access &&
+      std::is_same<typename E1::value_type, typename E2::value_type>::value &&
+      std::is_same<value_type, typename E1::value_type>::value;
+
+  /**
+   * @brief the number of matrix products reachable through elementwise nodes
+   *
+   */
+  static constexpr size_t fused_products =
+      util::fused_products<E1>::value + util::fused_products<E2>::value;
+
+  /**
+   * @brief true when both operands read element (i, j) at (i, j)
+   *
+   */
+  static constexpr bool pointwise =
+      util::pointwise<E1>::value && util::pointwise<E2>::value;
+
+  /**
+   * @brief the work of one element, the operands plus one operation
+   *
+   */
+  static constexpr size_t cost =
+      util::cost<E1>::value + util::cost<E2>::value + 1;
+
+  /**
+   * @brief the bytes read for one element, those of the operands
+   *
+   */
+  static constexpr size_t bytes_read =
+      util::bytes_read<E1>::value + util::bytes_read<E2>::value;
+
+  /**
+   * @brief Construct a new binary expr object
+   *
+   * @param u the first operand
+   * @param v the second operand
+   */
+  binary_expr(E1 const &u, E2 const &v) : _u(u), _v(v) {
+    util::assert_same_dimensions(u, v);
+  }
+
+  /**
+   * @brief returns the value at i in the result
+   *
+   * @param i the row index
+   * @return dtype the element of the matrix or expression
+   */
+  auto get(size_t i) const {
+    return Op()(_u.get(i), _v.get(util::safe_index(_u, _v, i)));
+  }
+
+  /**
+   * @brief returns the value at row i and column j in the result
+   *
+   * @param i the row index
+   * @param j the column index
+   * @return dtype the element of the matrix or expression
+   */
+  auto get(size_t i, size_t j) const {
+    return Op()(_u.get(i, j), _v.get(i, j));
+  }
+
+  /**
+   * @brief returns the packet of values starting at i in the result
+   *
+   * @param i the index of the first element of the packet
+   * @return the packet of the results
+   */
+  auto get_packet(size_t i) const {
+    return Op()(_u.get_packet(i), _v.get_packet(i));
+  }
+
+  /**
+   * @brief returns the value at row i and column j in the result, with acc
+   * standing in for the fused product below this node
+   *
+   * @tparam acc_t the type of the product
+   * @param i the row index
+   * @param j the column index
+   * @param acc the value of the product at row i and column j
+   * @return dtype the element of the result
+   */
+  template <class acc_t>
+  auto get_fused(size_t i, size_t j, acc_t const &acc) const {
+    return Op()(util::get_fused(_u, i, j, acc), util::get_fused(_v, i, j, acc));
+  }
+
+  /**
+   * @brief returns the single product reachable through elementwise nodes
+   *
+   * @return the product node
+   */
+  auto const &fused_product() const {
+    if constexpr (util::fused_products<E1>::value > 0)
+      return _u.fused_product();
+    else
+      return _v.fused_product();
+  }
+
+  /**
+   * @brief Runs the prepare hooks of both operands
+   *
+   * @param fused true when the caller evaluates the fused product itself
+   */
+  void prepare(bool fused) const {
+    util::prepare(_u, fused);
+    util::prepare(_v, fused);
+  }
+
+  /**
+   * @brief Runs the release hooks of both operands
+   *
+   */
+  void release() const {
+    util::release(_u);
+    util::release(_v);
+  }
+
+  /**
+   * @brief Checks if evaluating this node reads any element in [first, last)
+   *
+   * @param first the first byte of the range
+   * @param last one past the last byte of the range
+   * @return true if either operand may read the range
+   */
+  bool references(void const *first, void const *last) const {
+    return util::references(_u, first, last) ||
+           util::references(_v, first, last);
+  }
+
+  /**
+   * @brief Passes an access hint for the flat range [first, last) to both
+   * operands
+   *
+   * @param first the first flat index of the range
+   * @param last one past the last flat index of the range
+   * @param a the hint
+   */
+  void advise(size_t first, size_t last, storage::advice a) const {
+    util::advise(_u, first, last, a);
+    util::advise(_v, first, last, a);
+  }
+
+  /**
+   * @brief Get the dimension of this expression object.
+   *
+   * @return dimension of the expression.
+   */
+  auto get_dimension() const { return _u.get_dimension(); }
+
+  /**
+   * @brief Get the format object. Please note all the formats will collapse to
+   * the format of first operand. Natrually because of our evaluation startegy.
+   *
+   * @return the type of the format used in this matrix
    */
   auto get_format() const { return _u.get_format(); }
 };
 
 /**
- * @brief Constructs a representation of node for multiplication operation in
- * the Abstract Syntax Tree
+ * @brief The node for add operation in the Abstract Syntax Tree
+ *
+ */
+template <typename E1, typename E2>
+using add_expr = binary_expr<E1, E2, op::plus>;
+
+/**
+ * @brief The node for subtraction operation in the Abstract Syntax Tree
+ *
+ */
+template <typename E1, typename E2>
+using sub_expr = binary_expr<E1, E2, op::minus>;
+
+/**
+ * @brief The node for multiplication operation in the Abstract Syntax Tree
+ *
+ */
+template <typename E1, typename E2>
+using mul_expr = binary_expr<E1, E2, op::multiplies>;
+
+/**
+ * @brief The node for div operation in the Abstract Syntax Tree
+ *
+ */
+template <typename E1, typename E2>
+using div_expr = binary_expr<E1, E2, op::divides>;
+
+/**
+ * @brief Constructs a representation of a scalar leaf in the Abstract Syntax
+ * Tree. The value is broadcast to every position of a dimension and format
+ * copied from the other operand, so the nodes above it see an ordinary
+ * operand of the same shape and layout.
+ *
+ * @tparam value_t the type of the scalar
+ * @tparam format_t the format policy of the other operand
+ */
+template <typename value_t, typename format_t>
+class scalar_expr : public expression<scalar_expr<value_t, format_t>> {
+  value_t _value;
+  dimension _dimen;
+
+ public:
+  /**
+   * @brief the type of the scalar
+   *
+   */
+  using value_type = value_t;
+
+  /**
+   * @brief the format policy of the other operand
+   *
+   */
+  using format_type = format_t;
+
+  /**
+   * @brief a broadcast value is the same at every flat index
+   *
+   */
+  static constexpr bool uniform_layout = true;
+
+  /**
+   * @brief a broadcast value reads no matrix
+   *
+   */
+  static constexpr bool pointwise = true;
+
+  /**
+   * @brief a broadcast value fills a packet whenever value_t has one
+   *
+   */
+  static constexpr bool packet_access = simd::packet_traits<value_t>::size > 1;
+
+  /**
+   * @brief scalar leaves are created inside the operators, the nodes above
+   * must keep a copy of them.
+   *
+   */
+  static constexpr bool stored_by_value = true;
+
+  /**
+   * @brief a broadcast value is held in the node, no memory is read
+   *
+   */
+  static constexpr size_t bytes_read = 0;
+
+  /**
+   * @brief Construct a new scalar expr object
+   *
+   * @param value the value to broadcast
+   * @param dimen the dimension to broadcast it to
+   */
+  scalar_expr(value_t value, dimension dimen) : _value(value), _dimen(dimen) {}
+
+  /**
+   * @brief returns the broadcast value
+   *
+   * @return value_t the scalar
+   */
+  auto get(size_t) const { return _value; }
+
+  /**
+   * @brief returns the broadcast value
+   *
+   * @return value_t the scalar
+   */
+  auto get(size_t, size_t) const { return _value; }
+
+  /**
+   * @brief returns a packet with the value in every lane
+   *
+   * @return the broadcast packet
+   */
+  auto get_packet(size_t) const { return simd::packet_t<value_t>{} + _value; }
+
+  /**
+   * @brief Get the dimension the value is broadcast to.
+   *
+   * @return dimension of the other operand.
+   */
+  auto get_dimension() const { return _dimen; }
+
+  /**
+   * @brief Get the format object.
+   *
+   * @return the format of the other operand
+   */
+  auto get_format() const { return format_t(); }
+};
+
+/**
+ * @brief Wraps a scalar into a leaf broadcast to the shape and format of e.
+ * The value is converted to the common type of the scalar and the elements of
+ * e, like the built in arithmetic would.
+ *
+ * @tparam S the type of the scalar
+ * @tparam E the type of the other operand
+ * @param s the scalar
+ * @param e the other operand
+ * @return scalar_expr the broadcast leaf
+ */
+template <typename S, typename E,
+          typename = std::enable_if_t<util::is_scalar<S>::value>>
+auto broadcast(S const &s, expression<E> const &e) {
+  using value_t = std::common_type_t<typename E::value_type, S>;
+  return scalar_expr<value_t, typename E::format_type>(value_t(s),
+                                                       e.get_dimension());
+}
+
+/**
+ * @brief Overload for Expression type. This operation returns a add_expr object
+ * which can be evaluated to result it holds.
+ *
+ * @tparam E1 type of first operand
+ * @tparam E2 type of second operand
+ * @param u the first argument
+ * @param v the second argument
+ * @return add_expr<E1, E2> a proxy that represents a add operation.
+ */
+
+template <typename E1, typename E2>
+add_expr<E1, E2> operator+(expression<E1> const &u, expression<E2> const &v) {
+  return add_expr<E1, E2>(static_cast<E1 const &>(u),
+                         static_cast<E2 const &>(v));
+}
+
+/**
+ * @brief Overload for an Expression and a scalar. The scalar is broadcast to
+ * every element, the result stays lazy.
+ *
+ * @tparam E type of the expression
+ * @tparam S type of the scalar
+ * @param u the expression
+ * @param s the scalar
+ * @return add_expr a proxy that represents the operation.
+ */
+template <typename E, typename S,
+          typename = std::enable_if_t<util::is_scalar<S>::value>>
+auto operator+(expression<E> const &u, S const &s) {
+  auto v = broadcast(s, u);
+  return add_expr<E, decltype(v)>(static_cast<E const &>(u), v);
+}
+
+/**
+ * @brief Overload for a scalar and an Expression. The scalar is broadcast to
+ * every element, the result stays lazy.
+ *
+ * @tparam S type of the scalar
+ * @tparam E type of the expression
+ * @param s the scalar
+ * @param v the expression
+ * @return add_expr a proxy that represents the operation.
+ */
+template <typename S, typename E,
+          typename = std::enable_if_t<util::is_scalar<S>::value>>
+auto operator+(S const &s, expression<E> const &v) {
+  auto u = broadcast(s, v);
+  return add_expr<decltype(u), E>(u, static_cast<E const &>(v));
+}
+
+/**
+ * @brief Overload for Expression type. This operation returns a sub_expr object
+ * which can be evaluated to result it holds.
+ *
+ * @tparam E1 type of first operand
+ * @tparam E2 type of second operand
+ * @param u the first argument
+ * @param v the second argument
+ * @return sub_expr<E1, E2> a proxy that represents a add operation.
+ */
+
+template <typename E1, typename E2>
+sub_expr<E1, E2> operator-(expression<E1> const &u, expression<E2> const &v) {
+  return sub_expr<E1, E2>(static_cast<E1 const &>(u),
+                         static_cast<E2 const &>(v));
+}
+
+/**
+ * @brief Overload for an Expression and a scalar. The scalar is broadcast to
+ * every element, the result stays lazy.
+ *
+ * @tparam E type of the expression
+ * @tparam S type of the scalar
+ * @param u the expression
+ * @param s the scalar
+ * @return sub_expr a proxy that represents the operation.
+ */
+template <typename E, typename S,
+          typename = std::enable_if_t<util::is_scalar<S>::value>>
+auto operator-(expression<E> const &u, S const &s) {
+  auto v = broadcast(s, u);
+  return sub_expr<E, decltype(v)>(static_cast<E const &>(u), v);
+}
+
+/**
+ * @brief Overload for a scalar and an Expression. The scalar is broadcast to
+ * every element, the result stays lazy.
+ *
+ * @tparam S type of the scalar
+ * @tparam E type of the expression
+ * @param s the scalar
+ * @param v the expression
+ * @return sub_expr a proxy that represents the operation.
+ */
+template <typename S, typename E,
+          typename = std::enable_if_t<util::is_scalar<S>::value>>
+auto operator-(S const &s, expression<E> const &v) {
+  auto u = broadcast(s, v);
+  return sub_expr<decltype(u), E>(u, static_cast<E const &>(v));
+}
+
+/**
+ * @brief Overload for Expression type. This operation returns a mul_expr object
+ * which can be evaluated to result it holds.
+ *
+ * @tparam E1 type of first operand
+ * @tparam E2 type of second operand
+ * @param u the first argument
+ * @param v the second argument
+ * @return mul_expr<E1, E2> a proxy that represents a add operation.
+ */
+
+template <typename E1, typename E2>
+mul_expr<E1, E2> operator*(expression<E1> const &u, expression<E2> const &v) {
+  return mul_expr<E1, E2>(static_cast<E1 const &>(u),
+                         static_cast<E2 const &>(v));
+}
+
+/**
+ * @brief Overload for an Expression and a scalar. The scalar is broadcast to
+ * every element, the result stays lazy.
+ *
+ * @tparam E type of the expression
+ * @tparam S type of the scalar
+ * @param u the expression
+ * @param s the scalar
+ * @return mul_expr a proxy that represents the operation.
+ */
+template <typename E, typename S,
+          typename = std::enable_if_t<util::is_scalar<S>::value>>
+auto operator*(expression<E> const &u, S const &s) {
+  auto v = broadcast(s, u);
+  return mul_expr<E, decltype(v)>(static_cast<E const &>(u), v);
+}
+
+/**
+ * @brief Overload for a scalar and an Expression. The scalar is broadcast to
+ * every element, the result stays lazy.
+ *
+ * @tparam S type of the scalar
+ * @tparam E type of the expression
+ * @param s the scalar
+ * @param v the expression
+ * @return mul_expr a proxy that represents the operation.
+ */
+template <typename S, typename E,
+          typename = std::enable_if_t<util::is_scalar<S>::value>>
+auto operator*(S const &s, expression<E> const &v) {
+  auto u = broadcast(s, v);
+  return mul_expr<decltype(u), E>(u, static_cast<E const &>(v));
+}
+
+/**
+ * @brief Overload for Expression type. This operation returns a div_expr object
+ * which can be evaluated to result it holds.
+ *
+ * @tparam E1 type of first operand
+ * @tparam E2 type of second operand
+ * @param u the first argument
+ * @param v the second argument
+ * @return div_expr<E1, E2> a proxy that represents a add operation.
+ */
+
+template <typename E1, typename E2>
+div_expr<E1, E2> operator/(expression<E1> const &u, expression<E2> const &v) {
+  return div_expr<E1, E2>(static_cast<E1 const &>(u),
+                         static_cast<E2 const &>(v));
+}
+
+/**
+ * @brief Overload for an Expression and a scalar. The scalar is broadcast to
+ * every element, the result stays lazy.
+ *
+ * @tparam E type of the expression
+ * @tparam S type of the scalar
+ * @param u the expression
+ * @param s the scalar
+ * @return div_expr a proxy that represents the operation.
+ */
+template <typename E, typename S,
+          typename = std::enable_if_t<util::is_scalar<S>::value>>
+auto operator/(expression<E> const &u, S const &s) {
+  auto v = broadcast(s, u);
+  return div_expr<E, decltype(v)>(static_cast<E const &>(u), v);
+}
+
+/**
+ * @brief Overload for a scalar and an Expression. The scalar is broadcast to
+ * every element, the result stays lazy.
+ *
+ * @tparam S type of the scalar
+ * @tparam E type of the expression
+ * @param s the scalar
+ * @param v the expression
+ * @return div_expr a proxy that represents the operation.
+ */
+template <typename S, typename E,
+          typename = std::enable_if_t<util::is_scalar<S>::value>>
+auto operator/(S const &s, expression<E> const &v) {
+  auto u = broadcast(s, v);
+  return div_expr<decltype(u), E>(u, static_cast<E const &>(v));
+}
+
+/**
+ * @brief Constructs a representation of node for the transpose in the Abstract
+ * Syntax Tree. It never moves an element: the flat storage of a row major m x
+ * n operand read in column major order is its n x m transpose and vice versa,
+ * so this node only swaps the dimension and flips the format.
+ *
+ * @tparam E the operand type
+ */
+template <typename E>
+class transpose_expr : public expression<transpose_expr<E>> {
+  E const &_u;
+
+ public:
+  /**
+   * @brief the type of the elements produced by this node
+   *
+   */
+  using value_type = typename E::value_type;
+
+  /**
+   * @brief the format policy of this node, the opposite of the operand's
+   *
+   */
+  using format_type = typename E::format_type::transposed;
+
+  /**
+   * @brief flat indices of the operand are unchanged by the transpose
+   *
+   */
+  static constexpr bool uniform_layout = E::uniform_layout;
+
+  /**
+   * @brief packets of the operand are unchanged by the transpose
+   *
+   */
+  static constexpr bool packet_access = E::packet_access;
+
+  /**
+   * @brief the work of one element, the one of the operand
+   *
+   */
+  static constexpr size_t cost = util::cost<E>::value;
+
+  /**
+   * @brief the bytes read for one element, those of the operand
+   *
+   */
+  static constexpr size_t bytes_read = util::bytes_read<E>::value;
+
+  /**
+   * @brief Construct a new transpose expr object
+   *
+   * @param u the operand
+   */
+  explicit transpose_expr(E const &u) : _u(u) {}
+
+  /**
+   * @brief returns the value at i in the result
+   *
+   * @param i the flat index in format_type
+   * @return dtype the element of the matrix or expression
+   */
+  auto get(size_t i) const { return _u.get(i); }
+
+  /**
+   * @brief returns the value at row i and column j in the result
+   *
+   * @param i the row index
+   * @param j the column index
+   * @return dtype the element of the matrix or expression
+   */
+  auto get(size_t i, size_t j) const { return _u.get(j, i); }
+
+  /**
+   * @brief returns the packet of values starting at i in the result
+   *
+   * @param i the index of the first element of the packet
+   * @return the packet of the results
+   */
+  auto get_packet(size_t i) const { return _u.get_packet(i); }
+
+  /**
+   * @brief Runs the prepare hook of the operand. A product below a transpose
+   * is never fused.
+   *
+   */
+  void prepare(bool) const { util::prepare(_u); }
+
+  /**
+   * @brief Runs the release hook of the operand
+   *
+   */
+  void release() const { util::release(_u); }
+
+  /**
+   * @brief Checks if evaluating this node reads any element in [first, last)
+   *
+   * @param first the first byte of the range
+   * @param last one past the last byte of the range
+   * @return true if the operand may read the range
+   */
+  bool references(void const *first, void const *last) const {
+    return util::references(_u, first, last);
+  }
+
+  /**
+   * @brief Passes an access hint for the flat range [first, last) to the
+   * operand, whose flat order is the transposed one
+   *
+   * @param first the first flat index of the range
+   * @param last one past the last flat index of the range
+   * @param a the hint
+   */
+  void advise(size_t first, size_t last, storage::advice a) const {
+    util::advise(_u, first, last, a);
+  }
+
+  /**
+   * @brief Get the dimension of this expression object.
+   *
+   * @return dimension of the expression, the operand's swapped.
+   */
+  auto get_dimension() const {
+    dimension d = _u.get_dimension();
+    return dimension(d.col_dimen, d.row_dimen);
+  }
+
+  /**
+   * @brief Get the format object.
+   *
+   * @return the opposite of the operand's format
+   */
+  auto get_format() const { return format_type(); }
+};
+
+/**
+ * @brief Returns the lazy transpose of a matrix or expression. Nothing is
+ * copied, the result reinterprets the operand under the other format.
+ *
+ * @tparam E the type of the operand
+ * @param u the operand
+ * @return transpose_expr<E> a proxy that represents the transpose
+ */
+template <typename E>
+transpose_expr<E> transpose(expression<E> const &u) {
+  return transpose_expr<E>(static_cast<E const &>(u));
+}
+
+/**
+ * @brief A non owning view of a rectangular block of a matrix. It takes part
+ * in expressions like any other node and can be assigned to, which writes the
+ * parent in place. Views must not outlive the matrix they refer to.
+ *
+ * @tparam M the type of the viewed matrix, const qualified for a read only
+ * view
+ */
+template <typename M>
+class block_view : public expression<block_view<M>> {
+  M &_m;
+  size_t _row;
+  size_t _col;
+  dimension _dimen;
+
+  /**
+   * @brief Evaluates expr and combines every element into the viewed block
+   * with op. The block is walked tile by tile through get(i, j) in the
+   * parent's layout order, so the writes are contiguous runs of the parent.
+   * An expression reading the memory the block spans, like an overlapping
+   * block of the same parent, is evaluated into a temporary first.
+   *
+   * @tparam E the expression template
+   * @tparam Op the combining functor, called as op(old, new)
+   * @param expr the expression to evaluate
+   * @param op the functor producing the value to store
+   */
+  template <typename E, typename Op>
+  block_view &_assign(E const &expr, Op op) {
+    util::assert_same_dimensions(*this, expr);
+    if (_dimen.count() != 0) {
+      auto const *first = &_m.get(_row, _col);
+      auto const *last =
+          &_m.get(_row + _dimen.row_dimen - 1, _col + _dimen.col_dimen - 1);
+      if (util::references(expr, first, last + 1)) {
+        matrix<value_type, format_type> copy(expr);
+        return _assign(copy, op);
+      }
+    }
+    util::prepared<E> prepared(expr);
+    util::for_each_tiled<format_type::is_row_major>(
+        _dimen,
+        [&](size_t i, size_t j) {
+          auto &out = _m.get(_row + i, _col + j);
+          out = op(out, expr.get(i, j));
+        },
+        util::cost<E>::value);
+    return *this;
+  }
+
+ public:
+  /**
+   * @brief the type of the elements of the viewed matrix
+   *
+   */
+  using value_type = typename std::remove_const_t<M>::value_type;
+
+  /**
+   * @brief the format policy of the viewed matrix
+   *
+   */
+  using format_type = typename std::remove_const_t<M>::format_type;
+
+  /**
+   * @brief A block is strided in its parent, flat indices would need a div and
+   * a mod each so the evaluators walk it through get(i, j) instead.
+   *
+   */
+  static constexpr bool uniform_layout = false;
+
+  /**
+   * @brief A block is strided in its parent, it has no packets
+   *
+   */
+  static constexpr bool packet_access = false;
+
+  /**
+   * @brief Construct a new block view object
+   *
+   * @param m the viewed matrix
+   * @param r0 the first row of the block
+   * @param c0 the first column of the block
+   * @param rows the rows in the block
+   * @param cols the columns in the block
+   */
+  block_view(M &m, size_t r0, size_t c0, size_t rows, size_t cols)
+      : _m(m), _row(r0), _col(c0), _dimen(rows, cols) {
+    dimension parent = m.get_dimension();
+    if (r0 + rows > parent.row_dimen || c0 + cols > parent.col_dimen)
+      throw std::logic_error(
+          std::string("Block of dimension ") + _dimen.to_string() + " at [" +
+          std::to_string(r0) + "," + std::to_string(c0) +
+          "] does not fit in a matrix of dimension " + parent.to_string());
+  }
+
+  block_view(block_view const &other) = default;
+
+  /**
+   * @brief returns the value at i in the block
+   *
+   * @param i the flat index in format_type
+   * @return dtype the element of the block
+   */
+  auto get(size_t i) const {
+    if constexpr (format_type::is_row_major)
+      return get(i / _dimen.col_dimen, i % _dimen.col_dimen);
+    else
+      return get(i % _dimen.row_dimen, i / _dimen.row_dimen);
+  }
+
+  /**
+   * @brief returns the value at row i and column j in the block
+   *
+   * @param i the row index
+   * @param j the column index
+   * @return dtype the element of the block
+   */
+  auto get(size_t i, size_t j) const {
+    return static_cast<M const &>(_m).get(_row + i, _col + j);
+  }
+
+  /**
+   * @brief returns the element at row i and column j in the block by
+   * reference. It can be used to assign values to i,j as well.
+   *
+   * @param i the row index
+   * @param j the column index
+   * @return dtype the element of the block
+   */
+  auto &get(size_t i, size_t j) { return _m.get(_row + i, _col + j); }
+
+  /**
+   * @brief Checks if evaluating this view reads any element in [first, last)
+   *
+   * @param first the first byte of the range
+   * @param last one past the last byte of the range
+   * @return true if the viewed matrix overlaps the range
+   */
+  bool references(void const *first, void const *last) const {
+    return _m.references(first, last);
+  }
+
+  /**
+   * @brief Get the dimension of the block
+   *
+   * @return dimension the dimension of the block.
+   */
+  auto get_dimension() const { return _dimen; }
+
+  /**
+   * @brief Get the format object.
+   *
+   * @return the format of the viewed matrix
+   */
+  auto get_format() const { return format_type(); }
+
+  /**
+   * @brief Copies the elements of another view into this block
+   *
+   * @param other the view to copy from
+   * @return block_view& the reference to *this
+   */
+  block_view &operator=(block_view const &other) {
+    return _assign(other, [](auto const &, auto const &b) { return b; });
+  }
+
+  /**
+   * @brief Evaluates the expression into this block of the parent
+   *
+   * @tparam E the expression template
+   * @param expr the expression to evaluate
+   * @return block_view& the reference to *this
+   */
+  template <typename E>
+  block_view &operator=(expression<E> const &expr) {
+    return _assign(static_cast<E const &>(expr),
+                   [](auto const &, auto const &b) { return b; });
+  }
+
+  /**
+   * @brief Add and Assignment overload with expression.
+   *
+   * @tparam E the expression template
+   * @param expr the expression to evaluate and add to this block
+   * @return block_view& the reference to *this
+   */
+  template <typename E>
+  block_view &operator+=(expression<E> const &expr) {
+    return _assign(static_cast<E const &>(expr),
+                   [](auto const &a, auto const &b) { return a + b; });
+  }
+
+  /**
+   * @brief Subtract and Assignment overload with expression.
+   *
+   * @tparam E the expression template
+   * @param expr the expression to evaluate and subtract from this block
+   * @return block_view& the reference to *this
+   */
+  template <typename E>
+  block_view &operator-=(expression<E> const &expr) {
+    return _assign(static_cast<E const &>(expr),
+                   [](auto const &a, auto const &b) { return a - b; });
+  }
+
+  /**
+   * @brief Multiply and Assignment overload with expression.
+   *
+   * @tparam E the expression template
+   * @param expr the expression to evaluate and multiply into this block
+   * @return block_view& the reference to *this
+   */
+  template <typename E>
+  block_view &operator*=(expression<E> const &expr) {
+    return _assign(static_cast<E const &>(expr),
+                   [](auto const &a, auto const &b) { return a * b; });
+  }
+
+  /**
+   * @brief Division and Assignment overload with expression.
+   *
+   * @tparam E the expression template
+   * @param expr the expression to evaluate and divide this block by
+   * @return block_view& the reference to *this
+   */
+  template <typename E>
+  block_view &operator/=(expression<E> const &expr) {
+    return _assign(static_cast<E const &>(expr),
+                   [](auto const &a, auto const &b) { return a / b; });
+  }
+};
+
+/**
+ * @brief Returns a view of the rows x cols block of m starting at (r0, c0).
+ *
+ * @tparam M the type of the matrix, deduced const for a read only view
+ * @param m the viewed matrix
+ * @param r0 the first row of the block
+ * @param c0 the first column of the block
+ * @param rows the rows in the block
+ * @param cols the columns in the block
+ * @return block_view<M> the view
+ */
+template <typename M>
+block_view<M> block(M &m, size_t r0, size_t c0, size_t rows, size_t cols) {
+  return block_view<M>(m, r0, c0, rows, cols);
+}
+
+/**
+ * @brief Returns a view of the row r of m as a 1 x n block.
+ *
+ * @tparam M the type of the matrix, deduced const for a read only view
+ * @param m the viewed matrix
+ * @param r the row index
+ * @return block_view<M> the view
+ */
+template <typename M>
+block_view<M> row(M &m, size_t r) {
+  return block_view<M>(m, r, 0, 1, m.get_dimension().col_dimen);
+}
+
+/**
+ * @brief Returns a view of the column c of m as a m x 1 block.
+ *
+ * @tparam M the type of the matrix, deduced const for a read only view
+ * @param m the viewed matrix
+ * @param c the column index
+ * @return block_view<M> the view
+ */
+template <typename M>
+block_view<M> column(M &m, size_t c) {
+  return block_view<M>(m, 0, c, m.get_dimension().row_dimen, 1);
+}
+
+/**
+ * @brief Constructs a representation of the result of an axis reduction in
+ * the Abstract Syntax Tree. It is a rows x 1 or 1 x cols leaf holding one
+ * value per kept line, computed in a single pass over the reduced operand when
+ * the node is built. Only the kept dimension is ever stored.
+ *
+ * @tparam value_t the type of the reduced values
+ * @tparam format_t the format policy of the reduced operand
+ */
+template <typename value_t, typename format_t>
+class axis_expr : public expression<axis_expr<value_t, format_t>> {
+  std::vector<value_t> _values;
+  dimension _dimen;
+
+ public:
+  /**
+   * @brief the type of the reduced values
+   *
+   */
+  using value_type = value_t;
+
+  /**
+   * @brief the format policy of the reduced operand
+   *
+   */
+  using format_type = format_t;
+
+  /**
+   * @brief a vector has the same flat order under every format
+   *
+   */
+  static constexpr bool uniform_layout = true;
+
+  /**
+   * @brief a vector owns its values and reads no matrix
+   *
+   */
+  static constexpr bool pointwise = true;
+
+  /**
+   * @brief the values are contiguous, they have packets whenever value_t has
+   * one
+   *
+   */
+  static constexpr bool packet_access = simd::packet_traits<value_t>::size > 1;
+
+  /**
+   * @brief Construct a new axis expr object
+   *
+   * @param values one value per kept line
+   * @param dimen rows x 1 or 1 x cols
+   */
+  axis_expr(std::vector<value_t> &&values, dimension dimen)
+      : _values(std::move(values)), _dimen(dimen) {}
+
+  /**
+   * @brief returns the value at i
+   *
+   * @param i the index of the kept line
+   * @return value_t the reduced value
+   */
+  auto get(size_t i) const { return _values[i]; }
+
+  /**
+   * @brief returns the value at row i and column j, one of them is always 0
+   *
+   * @param i the row index
+   * @param j the column index
+   * @return value_t the reduced value
+   */
+  auto get(size_t i, size_t j) const { return _values[i + j]; }
+
+  /**
+   * @brief returns the packet of values starting at i
+   *
+   * @param i the index of the first element of the packet
+   * @return the packet of the reduced values
+   */
+  auto get_packet(size_t i) const { return simd::load(_values.data() + i); }
+
+  /**
+   * @brief Get the dimension of this expression object.
+   *
+   * @return dimension rows x 1 or 1 x cols
+   */
+  auto get_dimension() const { return _dimen; }
+
+  /**
+   * @brief Get the format object.
+   *
+   * @return the format of the reduced operand
+   */
+  auto get_format() const { return format_t(); }
+};
+
+/**
+ * @brief Constructs a representation of a vector repeated along its unit
+ * dimension in the Abstract Syntax Tree, so a rows x 1 or a 1 x cols operand
+ * can be combined with a full rows x cols one, e.g. to normalize every row.
+ *
+ * @tparam V the type of the repeated vector
+ * @tparam format_t the format policy of the other operand
+ */
+template <typename V, typename format_t>
+class broadcast_expr : public expression<broadcast_expr<V, format_t>> {
+  util::operand_t<V> _v;
+  dimension _dimen;
+  bool _column;
+
+ public:
+  /**
+   * @brief the type of the elements of the vector
+   *
+   */
+  using value_type = typename V::value_type;
+
+  /**
+   * @brief the format policy of the other operand
+   *
+   */
+  using format_type = format_t;
+
+  /**
+   * @brief a repeated value has no flat index in the other operand's order
+   * without a div and a mod, the evaluators walk it through get(i, j)
+   *
+   */
+  static constexpr bool uniform_layout = false;
+
+  /**
+   * @brief a repeated vector has no packets
+   *
+   */
+  static constexpr bool packet_access = false;
+
+  /**
+   * @brief Construct a new broadcast expr object
+   *
+   * @param v the vector to repeat, rows x 1 or 1 x cols
+   * @param dimen the dimension to repeat it to
+   */
+  broadcast_expr(V const &v, dimension dimen)
+      : _v(v), _dimen(dimen) {
+    dimension d = v.get_dimension();
+    bool fits = (d.col_dimen == 1 && d.row_dimen == dimen.row_dimen) ||
+                (d.row_dimen == 1 && d.col_dimen == dimen.col_dimen);
+    if (!fits)
+      throw std::logic_error(std::string("A vector of dimension ") +
+                             d.to_string() + " cannot be broadcast to " +
+                             dimen.to_string());
+    _column = d.col_dimen == 1 && d.row_dimen == dimen.row_dimen;
+  }
+
+  /**
+   * @brief returns the value at i in format_t order
+   *
+   * @param i the flat index
+   * @return dtype the repeated element
+   */
+  auto get(size_t i) const {
+    size_t line = format_t::is_row_major ? _dimen.col_dimen : _dimen.row_dimen;
+    return format_t::is_row_major ? get(i / line, i % line)
+                                  : get(i % line, i / line);
+  }
+
+  /**
+   * @brief returns the value at row i and column j
+   *
+   * @param i the row index
+   * @param j the column index
+   * @return dtype the repeated element
+   */
+  auto get(size_t i, size_t j) const {
+    return _column ? _v.get(i, 0) : _v.get(0, j);
+  }
+
+  /**
+   * @brief Runs the prepare hook of the vector
+   *
+   */
+  void prepare(bool) const { util::prepare(_v); }
+
+  /**
+   * @brief Runs the release hook of the vector
+   *
+   */
+  void release() const { util::release(_v); }
+
+  /**
+   * @brief Checks if evaluating this node reads any element in [first, last)
+   *
+   * @param first the first byte of the range
+   * @param last one past the last byte of the range
+   * @return true if the vector may read the range
+   */
+  bool references(void const *first, void const *last) const {
+    return util::references(_v, first, last);
+  }
+
+  /**
+   * @brief Get the dimension the vector is repeated to.
+   *
+   * @return dimension of the other operand.
+   */
+  auto get_dimension() const { return _dimen; }
+
+  /**
+   * @brief Get the format object.
+   *
+   * @return the format of the other operand
+   */
+  auto get_format() const { return format_t(); }
+};
+
+/**
+ * @brief Repeats a rows x 1 vector across the columns, or a 1 x cols vector
+ * down the rows, of e. The result stays lazy, e.g. a / broadcast(row_sum(a), a)
+ * normalizes every row of a in one pass.
+ *
+ * @tparam V the type of the vector
+ * @tparam E the type of the other operand
+ * @param v the vector
+ * @param e the other operand
+ * @return broadcast_expr the repeated vector
+ */
+template <typename V, typename E>
+auto broadcast(expression<V> const &v, expression<E> const &e) {
+  return broadcast_expr<V, typename E::format_type>(static_cast<V const &>(v),
+                                                    e.get_dimension());
+}
+
+/**
+ * @brief This namespace holds the computational kernels that are too large to
+ * live inside an operator overload.
+ *
+ */
+namespace kernel {
+
+/**
+ * @brief Cache blocking parameters for the matrix product of value_t. The
+ * micro tile mr x nr is held in registers, a kc x nr sliver of B lives in L1,
+ * a mc x kc block of A lives in L2 next to the mc x nt block of the output
+ * it accumulates into, and the packed B shared by all threads is read a kc x
+ * nt panel at a time.
+ *
+ * @tparam value_t the type of the elements being multiplied
+ */
+template <class value_t>
+struct gemm_blocking {
+  /**
+   * @brief the elements in one packet of value_t, 1 without packets
+   *
+   */
+  static constexpr size_t width = simd::packet_traits<value_t>::size;
+  /**
+   * @brief the vector registers of the target
+   *
+   */
+  static constexpr size_t registers = simd::register_bytes == 64 ? 32 : 16;
+  /**
+   * @brief columns of the register tile. Two packets of value_t, or one 64
+   * byte cache line but never less than 4 without packets.
+   *
+   */
+  static constexpr size_t nr =
+      width > 1 ? 2 * width
+                : (64 / sizeof(value_t) < 4 ? 4 : 64 / sizeof(value_t));
+  /**
+   * @brief rows of the register tile. As many as the registers hold next to
+   * one row of B and a broadcast element of A, 4 without packets.
+   *
+   */
+  static constexpr size_t mr = width > 1 ? (registers - 3) / 2 : 4;
+  /**
+   * @brief depth of a packed panel
+   *
+   */
+  static constexpr size_t kc = sizeof(value_t) > 8 ? 128 : 256;
+  /**
+   * @brief rows of a packed block of A. Multiple of mr
+   *
+   */
+  static constexpr size_t mc = 128 / mr * mr;
+  /**
+   * @brief columns of the output handed to one task. Multiple of nr. Halved,
+   * then mc too, while a product has fewer tasks than threads
+   *
+   */
+  static constexpr size_t nt = 256;
+};
+
+/**
+ * @brief Packed, cache blocked general matrix product C = A * B. Operands are
+ * read only through get(i, j) and only while packing, so any matrix like
+ * object works. B is packed whole up front, then every mc x nt block of the
+ * output is owned by exactly one task which accumulates it over the whole
+ * depth before handing it out, so the parallel loop is free of races and
+ * every element is stored exactly once.
+ *
+ * @tparam value_t the type of the elements of the result
+ */
+template <class value_t>
+struct gemm {
+  using blocking = gemm_blocking<value_t>;
+  static constexpr size_t mr = blocking::mr;
+  static constexpr size_t nr = blocking::nr;
+
+  /**
+   * @brief Packs the mc x kc block of A starting at (i0, p0) into micro panels
+   * of mr rows. Each micro panel is stored column by column so that the micro
+   * kernel reads it sequentially. Rows past the edge are zero padded. A is
+   * read along its contiguous axis: row by row when it is row major, column
+   * by column otherwise.
+   *
+   * @tparam E the type of A
+   * @param a the left operand
+   * @param i0 the first row of the block
+   * @param p0 the first column of the block
+   * @param mc the rows in the block
+   * @param kc the columns in the block
+   * @param buffer the destination of atleast ceil(mc / mr) * mr * kc elements
+   */
+  template <class E>
+  static void pack_a(E const &a, size_t i0, size_t p0, size_t mc, size_t kc,
+                     value_t *buffer) {
+    for (size_t ir = 0; ir < mc; ir += mr) {
+      size_t rows = mc - ir < mr ? mc - ir : mr;
+      value_t *panel = buffer + ir * kc;
+      if constexpr (E::format_type::is_row_major) {
+        for (size_t i = 0; i < mr; i++) {
+          if (i < rows)
+            for (size_t p = 0; p < kc; p++)
+              panel[p * mr + i] = a.get(i0 + ir + i, p0 + p);
+          else
+            for (size_t p = 0; p < kc; p++) panel[p * mr + i] = value_t();
+        }
+      } else {
+        for (size_t p = 0; p < kc; p++)
+          for (size_t i = 0; i < mr; i++)
+            panel[p * mr + i] =
+                i < rows ? a.get(i0 + ir + i, p0 + p) : value_t();
+      }
+    }
+  }
+
+  /**
+   * @brief Packs the kc x nc panel of B starting at (p0, j0) into micro panels
+   * of nr columns. Each micro panel is stored row by row so that the micro
+   * kernel reads it sequentially. Columns past the edge are zero padded. B is
+   * read along its contiguous axis: row by row when it is row major, column
+   * by column otherwise.
+   *
+   * @tparam E the type of B
+   * @param b the right operand
+   * @param p0 the first row of the panel
+   * @param j0 the first column of the panel
+   * @param kc the rows in the panel
+   * @param nc the columns in the panel
+   * @param buffer the destination of atleast ceil(nc / nr) * nr * kc elements
+   */
+  template <class E>
+  static void pack_b(E const &b, size_t p0, size_t j0, size_t kc, size_t nc,
+                     value_t *buffer) {
+    size_t panels = (nc + nr - 1) / nr;
+    for (size_t jp = 0; jp < panels; jp++) {
+      size_t jr = jp * nr;
+      size_t cols = nc - jr < nr ? nc - jr : nr;
+      value_t *panel = buffer + jr * kc;
+      if constexpr (E::format_type::is_row_major) {
+        for (size_t p = 0; p < kc; p++)
+          for (size_t j = 0; j < nr; j++)
+            panel[p * nr + j] =
+                j < cols ? b.get(p0 + p, j0 + jr + j) : value_t();
+      } else {
+        for (size_t j = 0; j < nr; j++) {
+          if (j < cols)
+            for (size_t p = 0; p < kc; p++)
+              panel[p * nr + j] = b.get(p0 + p, j0 + jr + j);
+          else
+            for (size_t p = 0; p < kc; p++) panel[p * nr + j] = value_t();
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Computes the mr x nr register tile acc = a * b from one packed
+   * micro panel of A and one of B. The tile is held in mr x nr / width packet
+   * accumulators, every step loads one row of the panel of B as packets and
+   * broadcasts each element of the column of A against it. Types without
+   * packets accumulate element by element.
+   *
+   * @param kc the depth of the micro panels
+   * @param a the packed micro panel of A
+   * @param b the packed micro panel of B
+   * @param acc the mr x nr row major result tile
+   */
+  static void micro_kernel(size_t kc, value_t const *a, value_t const *b,
+                           value_t *acc) {
+    constexpr size_t width = simd::packet_traits<value_t>::size;
+    if constexpr (width > 1 && nr % width == 0) {
+      using packet = simd::packet_t<value_t>;
+      constexpr size_t lanes = nr / width;
+      packet c[mr][lanes] = {};
+      for (size_t p = 0; p < kc; p++) {
+        value_t const *ap = a + p * mr;
+        value_t const *bp = b + p * nr;
+        packet row[lanes];
+        for (size_t j = 0; j < lanes; j++) row[j] = simd::load(bp + j * width);
+        for (size_t i = 0; i < mr; i++) {
+          packet column = simd::set1(ap[i]);
+          for (size_t j = 0; j < lanes; j++) c[i][j] += column * row[j];
+        }
+      }
+      for (size_t i = 0; i < mr; i++)
+        for (size_t j = 0; j < lanes; j++)
+          simd::store(acc + i * nr + j * width, c[i][j]);
+    } else {
+      value_t c[mr][nr] = {};
+      for (size_t p = 0; p < kc; p++) {
+        value_t const *ap = a + p * mr;
+        value_t const *bp = b + p * nr;
+        for (size_t i = 0; i < mr; i++)
+          for (size_t j = 0; j < nr; j++) c[i][j] += ap[i] * bp[j];
+      }
+      for (size_t i = 0; i < mr; i++)
+        for (size_t j = 0; j < nr; j++) acc[i * nr + j] = c[i][j];
+    }
+  }
+
+  /**
+   * @brief Returns packing buffer which of the calling thread, grown to hold
+   * at least size elements. The buffers are kept between products so that
+   * the tasks of the kernel never allocate.
+   *
+   * @param which 0 for the panel of A, 1 for the block of C
+   * @param size the elements needed
+   * @return value_t* the buffer
+   */
+  static value_t *_buffer(size_t which, size_t size) {
+    thread_local storage::aligned_vector<value_t> buffers[2];
+    if (buffers[which].size() < size) buffers[which].resize(size);
+    return buffers[which].data();
+  }
+
+  /**
+   * @brief Returns the packed panels of B of the thread calling run, grown to
+   * hold at least size elements. It is kept between products, on huge pages
+   * when large, and never zero filled: pack_b writes every element the micro
+   * kernel reads, and the pages are first touched by the packing tasks.
+   * Elements are arithmetic or std::complex, so assigning raw memory is fine.
+   *
+   * @param size the elements needed
+   * @return value_t* the buffer
+   */
+  static value_t *_b_pack(size_t size) {
+    struct panels {
+      value_t *data = nullptr;
+      size_t size = 0;
+      ~panels() {
+        if (data != nullptr)
+          storage::huge_page_allocator<value_t>().deallocate(data, size);
+      }
+    };
+    thread_local panels b;
+    if (b.size < size) {
+      storage::huge_page_allocator<value_t> allocator;
+      if (b.data != nullptr) allocator.deallocate(b.data, b.size);
+      b.data = nullptr;
+      b.size = 0;
+      b.data = allocator.allocate(size);
+      b.size = size;
+    }
+    return b.data;
+  }
+
+  /**
+   * @brief Computes A * B and hands every element of the result to store
+   * exactly once, as store(i, j, value), right after its last accumulation.
+   * Since A and B are fully read by then for that element only, store may
+   * combine the value with anything that does not alias A or B.
+   *
+   * @tparam E1 the type of A
+   * @tparam E2 the type of B
+   * @tparam Store the type of the callback
+   * @param a the m x k left operand
+   * @param b the k x n right operand
+   * @param store the callback receiving the elements of the result
+   */
+  template <class E1, class E2, class Store>
+  static void run(E1 const &a, E2 const &b, Store const &store) {
+    size_t m = a.get_dimension().row_dimen;
+    size_t k = a.get_dimension().col_dimen;
+    size_t n = b.get_dimension().col_dimen;
+    if (m == 0 || n == 0) return;
+
+    // Buffers are sized for the problem, small products stay on the heap
+    // fast path instead of mapping and faulting in full blocks.
+    size_t padded_n = (n + nr - 1) / nr * nr;
+    size_t padded_m = (m + mr - 1) / mr * mr;
+    size_t work = m * n * k;
+    size_t block_cols = padded_n < blocking::nt ? padded_n : blocking::nt;
+    size_t block_rows = padded_m < blocking::mc ? padded_m : blocking::mc;
+    if (execution::parallel(work)) {
+      // Smaller tiles until every thread has a block of the output.
+      size_t threads = execution::current().concurrency();
+      auto tasks = [&] {
+        return ((m + block_rows - 1) / block_rows) *
+               ((n + block_cols - 1) / block_cols);
+      };
+      while (tasks() < threads && (block_cols > nr || block_rows > mr)) {
+        if (block_cols > nr)
+          block_cols = (block_cols / 2 + nr - 1) / nr * nr;
+        else
+          block_rows = (block_rows / 2 + mr - 1) / mr * mr;
+      }
+    }
+    size_t block_depth = k < blocking::kc ? k : blocking::kc;
+    size_t panels = (k + blocking::kc - 1) / blocking::kc;
+    size_t row_blocks = (m + block_rows - 1) / block_rows;
+    size_t col_blocks = (n + block_cols - 1) / block_cols;
+    value_t *b_pack = _b_pack(k * padded_n);
+    execution::for_each(panels * col_blocks, work, [&](size_t t) {
+      size_t pc = (t / col_blocks) * blocking::kc;
+      size_t jt = (t % col_blocks) * block_cols;
+      size_t kc = k - pc < blocking::kc ? k - pc : blocking::kc;
+      size_t nt = n - jt < block_cols ? n - jt : block_cols;
+      pack_b(b, pc, jt, kc, nt, b_pack + pc * padded_n + jt * kc);
+    });
+
+    execution::for_each(row_blocks * col_blocks, work, [&](size_t t) {
+      value_t *a_pack = _buffer(0, block_rows * block_depth);
+      value_t *c_block = _buffer(1, block_rows * block_cols);
+      value_t acc[mr * nr];
+      size_t ic = (t / col_blocks) * block_rows;
+      size_t jt = (t % col_blocks) * block_cols;
+      size_t mc = m - ic < block_rows ? m - ic : block_rows;
+      size_t nt = n - jt < block_cols ? n - jt : block_cols;
+      std::fill(c_block, c_block + block_rows * block_cols, value_t());
+
+      for (size_t pc = 0; pc < k; pc += blocking::kc) {
+        size_t kc = k - pc < blocking::kc ? k - pc : blocking::kc;
+        pack_a(a, ic, pc, mc, kc, a_pack);
+        value_t const *panel = b_pack + pc * padded_n + jt * kc;
+        for (size_t jr = 0; jr < nt; jr += nr) {
+          size_t cols = nt - jr < nr ? nt - jr : nr;
+          for (size_t ir = 0; ir < mc; ir += mr) {
+            size_t rows = mc - ir < mr ? mc - ir : mr;
+            micro_kernel(kc, a_pack + ir * kc, panel + jr * kc, acc);
+            value_t *ct = c_block + ir * block_cols + jr;
+            for (size_t i = 0; i < rows; i++)
+              for (size_t j = 0; j < cols; j++)
+                ct[i * block_cols + j] += acc[i * nr + j];
+          }
+        }
+      }
+
+      for (size_t i = 0; i < mc; i++)
+        for (size_t j = 0; j < nt; j++)
+          store(ic + i, jt + j, c_block[i * block_cols + j]);
+    });
+  }
+
+  /**
+   * @brief Computes C = A * B.
+   *
+   * @tparam E1 the type of A
+   * @tparam E2 the type of B
+   * @param a the m x k left operand
+   * @param b the k x n right operand
+   * @param c the pointer to the first element of the m x n output
+   * @param rs_c the distance between two rows of the output
+   * @param cs_c the distance between two columns of the output
+   */
+  template <class E1, class E2>
+  static void run(E1 const &a, E2 const &b, value_t *c, size_t rs_c,
+                  size_t cs_c) {
+    run(a, b, [=](size_t i, size_t j, value_t const &v) {
+      c[i * rs_c + j * cs_c] = v;
+    });
+  }
+};
+
+/**
+ * @brief Evaluates a chain of three or more matrix products in the order with
+ * the fewest multiplications, found by dynamic programming over the dimensions
+ * of the operands at evaluation time. Intermediate products are kept in row
+ * major buffers drawn from a pool, a buffer is returned to the pool as soon
+ * as the product that reads it is stored so later intermediates reuse it.
+ *
+ * @tparam value_t the type of the elements of the result
+ */
+template <class value_t>
+class chain {
+  std::vector<size_t> _dims;
+  std::vector<size_t> _split;
+  std::vector<std::vector<value_t>> _pool;
+  size_t _n;
+
+  /**
+   * @brief Calls f with the operand at a runtime index of the tuple.
+   *
+   * @tparam Leaves the tuple of operands
+   * @tparam F the type of the callback
+   * @param leaves the operands
+   * @param index the index of the operand to pass to f
+   * @param f the callback
+   */
+  template <class Leaves, class F, size_t... I>
+  static void _visit(Leaves const &leaves, size_t index, F const &f,
+                     std::index_sequence<I...>) {
+    ((index == I ? f(std::get<I>(leaves)) : void()), ...);
+  }
+
+  /**
+   * @brief Takes the smallest pooled buffer holding count elements without
+   * growing, or the largest one grown to count.
+   *
+   * @param count the number of elements needed
+   * @return std::vector<value_t> the buffer, of size count
+   */
+  std::vector<value_t> _acquire(size_t count) {
+    std::vector<value_t> buffer;
+    size_t best = _pool.size();
+    for (size_t b = 0; b < _pool.size(); b++) {
+      size_t have = _pool[b].capacity();
+      size_t kept = best == _pool.size() ? 0 : _pool[best].capacity();
+      if (best == _pool.size() ||
+          (kept < count ? have > kept : have >= count && have < kept))
+        best = b;
+    }
+    if (best != _pool.size()) {
+      buffer = std::move(_pool[best]);
+      _pool.erase(_pool.begin() + best);
+    }
+    buffer.resize(count);
+    return buffer;
+  }
+
+  /**
+   * @brief Stores the elements of an intermediate product in a row major
+   * buffer.
+   *
+   */
+  struct _store {
+    value_t *out;
+    size_t cols;
+    void operator()(size_t i, size_t j, value_t const &v) const {
+      out[i * cols + j] = v;
+    }
+  };
+
+  /**
+   * @brief Calls f with the product of the operands first to last, the
+   * operand itself when first == last.
+   *
+   * @tparam Leaves the tuple of operands
+   * @tparam F the type of the callback
+   * @param leaves the operands
+   * @param first the index of the first operand
+   * @param last the index of the last operand
+   * @param f the callback
+   */
+  template <class Leaves, class F>
+  void _operand(Leaves const &leaves, size_t first, size_t last, F const &f) {
+    if (first == last) {
+      _visit(leaves, first, f,
+             std::make_index_sequence<std::tuple_size<Leaves>::value>());
+      return;
+    }
+    size_t rows = _dims[first], cols = _dims[last + 1];
+    std::vector<value_t> buffer = _acquire(rows * cols);
+    _product(leaves, first, last, _store{buffer.data(), cols});
+    f(matrix<value_t, policy::RowMajorPolicy<value_t>,
+             storage::external<value_t>>(buffer.data(), rows, cols));
+    _pool.push_back(std::move(buffer));
+  }
+
+  /**
+   * @brief Multiplies the operands first to last along the planned split and
+   * hands the elements of the product to store.
+   *
+   * @tparam Leaves the tuple of operands
+   * @tparam Store the type of the callback
+   * @param leaves the operands
+   * @param first the index of the first operand
+   * @param last the index of the last operand, greater than first
+   * @param store the callback, called as store(i, j, value)
+   */
+  template <class Leaves, class Store>
+  void _product(Leaves const &leaves, size_t first, size_t last,
+                Store const &store) {
+    size_t split = _split[first * _n + last];
+    _operand(leaves, first, split, [&](auto const &u) {
+      _operand(leaves, split + 1, last, [&](auto const &v) {
+        gemm<value_t>::run(u, v, store);
+      });
+    });
+  }
+
+ public:
+  /**
+   * @brief Plans the order of the chain. Operand i is dims[i] x dims[i + 1].
+   *
+   * @param dims the n + 1 dimensions of the n operands
+   */
+  explicit chain(std::vector<size_t> dims)
+      : _dims(std::move(dims)), _n(_dims.size() - 1) {
+    std::vector<double> cost(_n * _n, 0.0);
+    _split.assign(_n * _n, 0);
+    for (size_t length = 2; length <= _n; length++)
+      for (size_t first = 0; first + length <= _n; first++) {
+        size_t last = first + length - 1;
+        double &best = cost[first * _n + last];
+        for (size_t split = first; split < last; split++) {
+          double c = cost[first * _n + split] +
+                     cost[(split + 1) * _n + last] +
+                     double(_dims[first]) * double(_dims[split + 1]) *
+                         double(_dims[last + 1]);
+          if (split == first || c < best) {
+            best = c;
+            _split[first * _n + last] = split;
+          }
+        }
+      }
+  }
+
+  /**
+   * @brief Returns where the planned order splits the operands first to last
+   * for the last multiplication.
+   *
+   * @param first the index of the first operand
+   * @param last the index of the last operand, greater than first
+   * @return size_t the index of the last operand of the left half
+   */
+  size_t split(size_t first, size_t last) const {
+    return _split[first * _n + last];
+  }
+
+  /**
+   * @brief Multiplies the chain in the planned order and hands every element
+   * of the result to store exactly once, see gemm::run
+   *
+   * @tparam Leaves the tuple of operands
+   * @tparam Store the type of the callback
+   * @param leaves the operands, at least two
+   * @param store the callback, called as store(i, j, value)
+   */
+  template <class Leaves, class Store>
+  void run(Leaves const &leaves, Store const &store) {
+    _product(leaves, 0, _n - 1, store);
+  }
+
+  /**
+   * @brief Collects the dimensions of a tuple of chained operands.
+   *
+   * @tparam Leaves the tuple of operands
+   * @param leaves the operands
+   * @return std::vector<size_t> the dimensions, see the constructor
+   */
+  template <class Leaves>
+  static std::vector<size_t> dimensions(Leaves const &leaves) {
+    std::vector<size_t> dims;
+    std::apply(
+        [&](auto const &first, auto const &...rest) {
+          dims.push_back(first.get_dimension().row_dimen);
+          dims.push_back(first.get_dimension().col_dimen);
+          (dims.push_back(rest.get_dimension().col_dimen), ...);
+        },
+        leaves);
+    return dims;
+  }
+};
+
+/**
+ * @brief Functor that adds two values or two packets.
+ *
+ */
+struct fold_sum {
+  template <class T>
+  T operator()(T const &a, T const &b) const {
+    return a + b;
+  }
+};
+
+/**
+ * @brief Functor that keeps the smaller of two values, lane by lane for
+ * packets.
+ *
+ */
+struct fold_min {
+  template <class T>
+  T operator()(T a, T const &b) const {
+    if constexpr (std::is_arithmetic<T>::value) {
+      return b < a ? b : a;
+    } else {
+      for (size_t k = 0; k < sizeof(T) / sizeof(a[0]); k++)
+        if (b[k] < a[k]) a[k] = b[k];
+      return a;
+    }
+  }
+};
+
+/**
+ * @brief Functor that keeps the larger of two values, lane by lane for
+ * packets.
+ *
+ */
+struct fold_max {
+  template <class T>
+  T operator()(T a, T const &b) const {
+    if constexpr (std::is_arithmetic<T>::value) {
+      return a < b ? b : a;
+    } else {
+      for (size_t k = 0; k < sizeof(T) / sizeof(a[0]); k++)
+        if (a[k] < b[k]) a[k] = b[k];
+      return a;
+    }
+  }
+};
+
+/**
+ * @brief Folds every element of an expression into one value without
+ * materializing the expression. Every thread folds a private partial over its
+ * share of the elements, a packet at a time when the tree allows it, and the
+ * partials are combined once at the end.
+ *
+ */
+struct reduce {
+  /**
+   * @brief Computes fold(...fold(identity, map(e0))..., map(en)). Each range
+   * of elements is folded by one task and the partial results are folded in
+   * order, so the grouping only depends on the number of ranges.
+   *
+   * @tparam acc_t the type of the accumulator
+   * @tparam E the type of the expression
+   * @tparam Map maps an element, or a packet of acc_t, to acc_t or its packet
+   * @tparam Fold an associative and commutative combine of two accumulators
+   * @param expr the expression to reduce
+   * @param identity the identity of fold
+   * @param map the per element transform
+   * @param fold the combine
+   * @return acc_t the reduced value
+   */
+  template <class acc_t, class E, class Map, class Fold>
+  static acc_t run(E const &expr, acc_t identity, Map const &map,
+                   Fold const &fold) {
+    util::prepared<E> prepared(expr);
+    auto dimen = expr.get_dimension();
+    acc_t result = identity;
+    if constexpr (E::uniform_layout) {
+      using packet = simd::packet_t<acc_t>;
+      constexpr size_t width = simd::packet_traits<acc_t>::size;
+      constexpr bool packed =
+          std::is_same<typename E::value_type, acc_t>::value &&
+          util::maps_packets<E, Map, packet>::value;
+      size_t count = dimen.count();
+      size_t work = count * util::cost<E>::value;
+      size_t length = execution::grain(count, work, packed ? width : 1);
+      std::vector<acc_t> partials((count + length - 1) / length, identity);
+      execution::for_each(partials.size(), work, [&](size_t t) {
+        size_t i = t * length;
+        size_t last = count - i < length ? count : i + length;
+        acc_t partial = identity;
+        if constexpr (packed) {
+          packet lanes = simd::set1(identity);
+          for (; i + width <= last; i += width)
+            lanes = fold(lanes, map(expr.get_packet(i)));
+          acc_t values[width];
+          simd::store(values, lanes);
+          for (auto const &v : values) partial = fold(partial, v);
+        }
+        for (; i < last; i++) partial = fold(partial, map(expr.get(i)));
+        partials[t] = partial;
+      });
+      for (auto const &p : partials) result = fold(result, p);
+    } else {
+      constexpr bool row_major = E::format_type::is_row_major;
+      size_t lines = row_major ? dimen.row_dimen : dimen.col_dimen;
+      size_t along = row_major ? dimen.col_dimen : dimen.row_dimen;
+      size_t work = dimen.count() * util::cost<E>::value;
+      size_t length = execution::grain(lines, work);
+      std::vector<acc_t> partials((lines + length - 1) / length, identity);
+      execution::for_each(partials.size(), work, [&](size_t t) {
+        size_t first = t * length;
+        size_t last = lines - first < length ? lines : first + length;
+        acc_t partial = identity;
+        for (size_t l = first; l < last; l++)
+          for (size_t k = 0; k < along; k++)
+            partial = fold(partial, map(row_major ? expr.get(l, k)
+                                                  : expr.get(k, l)));
+        partials[t] = partial;
+      });
+      for (auto const &p : partials) result = fold(result, p);
+    }
+    return result;
+  }
+};
+
+/**
+ * @brief Folds every line of an expression into one value per line. A line
+ * along the operand's contiguous axis is streamed by one thread. Lines across
+ * it are folded a block of tile_along lines at a time, so every step reads a
+ * contiguous run of the operand into a block of accumulators held in cache.
+ * Both paths are parallel across the kept dimension.
  *
- * @tparam E1 the first operand type
- * @tparam E2 the second operand type
  */
+struct axis_reduce {
+  /**
+   * @brief Computes fold(...fold(identity, map(x0, 0))..., map(xn, n)) for
+   * every kept line, in increasing order along the line.
+   *
+   * @tparam rowwise true to fold each row, false to fold each column
+   * @tparam acc_t the type of the accumulator
+   * @tparam E the type of the expression
+   * @tparam Map maps an element and its index along the line to acc_t
+   * @tparam Fold combines two accumulators
+   * @param expr the expression to reduce
+   * @param identity the identity of fold
+   * @param map the per element transform
+   * @param fold the combine
+   * @return std::vector<acc_t> one value per kept line
+   */
+  template <bool rowwise, class acc_t, class E, class Map, class Fold>
+  static std::vector<acc_t> run(E const &expr, acc_t identity, Map const &map,
+                                Fold const &fold) {
+    util::prepared<E> prepared(expr);
+    auto dimen = expr.get_dimension();
+    size_t kept = rowwise ? dimen.row_dimen : dimen.col_dimen;
+    size_t along = rowwise ? dimen.col_dimen : dimen.row_dimen;
+    std::vector<acc_t> out(kept, identity);
+    auto at = [&](size_t k, size_t r) {
+      return rowwise ? expr.get(k, r) : expr.get(r, k);
+    };
+    size_t work = dimen.count() * util::cost<E>::value;
+    if constexpr (rowwise == E::format_type::is_row_major) {
+      execution::for_ranges(kept, work, [&](size_t first, size_t last) {
+        for (size_t k = first; k < last; k++) {
+          acc_t acc = identity;
+          for (size_t r = 0; r < along; r++)
+            acc = fold(acc, map(at(k, r), r));
+          out[k] = acc;
+        }
+      });
+    } else {
+      size_t blocks = (kept + util::tile_along - 1) / util::tile_along;
+      execution::for_each(blocks, work, [&](size_t b) {
+        size_t k0 = b * util::tile_along;
+        size_t k1 = kept - k0 < util::tile_along ? kept : k0 + util::tile_along;
+        for (size_t r = 0; r < along; r++)
+          for (size_t k = k0; k < k1; k++)
+            out[k] = fold(out[k], map(at(k, r), r));
+      });
+    }
+    return out;
+  }
+
+  /**
+   * @brief Wraps the reduced values into a rows x 1 or 1 x cols leaf.
+   *
+   * @tparam rowwise true if each row was folded
+   * @tparam format_t the format policy of the reduced expression
+   * @tparam value_t the type of the reduced values
+   * @param values one value per kept line
+   * @return axis_expr the leaf
+   */
+  template <bool rowwise, class format_t, class value_t>
+  static auto wrap(std::vector<value_t> &&values) {
+    size_t kept = values.size();
+    dimension dimen = rowwise ? dimension(kept, 1) : dimension(1, kept);
+    return axis_expr<value_t, format_t>(std::move(values), dimen);
+  }
+
+  /**
+   * @brief Throws if the lines of expr are empty, they have no max or mean.
+   *
+   * @tparam rowwise true if each row is folded
+   * @tparam E the type of the expression
+   * @param expr the expression
+   * @param what the name of the reduction
+   */
+  template <bool rowwise, class E>
+  static void assert_nonempty(E const &expr, char const *what) {
+    auto dimen = expr.get_dimension();
+    if ((rowwise ? dimen.col_dimen : dimen.row_dimen) == 0)
+      throw std::logic_error(std::string(what) +
+                             " cannot be called on lines of a matrix with "
+                             "dimension " +
+                             dimen.to_string());
+  }
+
+  /**
+   * @brief Computes the sum of every line.
+   *
+   * @tparam rowwise true to reduce each row, false to reduce each column
+   * @tparam E the type of the expression
+   * @param expr the expression to reduce
+   * @return axis_expr one value per kept line
+   */
+  template <bool rowwise, class E>
+  static auto sum(E const &expr) {
+    using value_t = typename E::value_type;
+    return wrap<rowwise, typename E::format_type>(run<rowwise>(
+                  expr, value_t(), [](value_t const &x, size_t) { return x; },
+                  fold_sum()));
+  }
+
+  /**
+   * @brief Computes the largest element of every line.
+   *
+   * @tparam rowwise true to reduce each row, false to reduce each column
+   * @tparam E the type of the expression
+   * @param expr the expression to reduce
+   * @return axis_expr one value per kept line
+   */
+  template <bool rowwise, class E>
+  static auto max(E const &expr) {
+    assert_nonempty<rowwise>(expr, "max");
+    using value_t = typename E::value_type;
+    return wrap<rowwise, typename E::format_type>(run<rowwise>(
+                  expr, std::numeric_limits<value_t>::lowest(),
+                  [](value_t const &x, size_t) { return x; }, fold_max()));
+  }
+
+  /**
+   * @brief Computes the index along the line of the largest element of every
+   * line, the first one on ties.
+   *
+   * @tparam rowwise true to reduce each row, false to reduce each column
+   * @tparam E the type of the expression
+   * @param expr the expression to reduce
+   * @return axis_expr one index per kept line
+   */
+  template <bool rowwise, class E>
+  static auto argmax(E const &expr) {
+    assert_nonempty<rowwise>(expr, "argmax");
+    using value_t = typename E::value_type;
+    using best_t = std::pair<value_t, size_t>;
+    auto best = run<rowwise>(
+        expr, best_t(std::numeric_limits<value_t>::lowest(), 0),
+        [](value_t const &x, size_t r) { return best_t(x, r); },
+        [](best_t const &a, best_t const &b) {
+          return a.first < b.first ? b : a;
+        });
+    std::vector<size_t> index(best.size());
+    for (size_t k = 0; k < best.size(); k++) index[k] = best[k].second;
+    return wrap<rowwise, typename E::format_type>(std::move(index));
+  }
+
+  /**
+   * @brief Computes the mean of every line, in double for integers.
+   *
+   * @tparam rowwise true to reduce each row, false to reduce each column
+   * @tparam E the type of the expression
+   * @param expr the expression to reduce
+   * @return axis_expr one value per kept line
+   */
+  template <bool rowwise, class E>
+  static auto mean(E const &expr) {
+    assert_nonempty<rowwise>(expr, "mean");
+    using value_t = typename E::value_type;
+    using mean_t = std::conditional_t<std::is_integral<value_t>::value, double,
+                                      value_t>;
+    auto dimen = expr.get_dimension();
+    size_t along = rowwise ? dimen.col_dimen : dimen.row_dimen;
+    auto values = run<rowwise>(
+        expr, mean_t(), [](value_t const &x, size_t) { return mean_t(x); },
+        fold_sum());
+    for (auto &v : values) v /= static_cast<mean_t>(along);
+    return wrap<rowwise, typename E::format_type>(std::move(values));
+  }
+};
+
+/**
+ * @brief The product of two fixed matrices, one statement per element of the
+ * result and one term per element of the shared dimension, all unrolled at
+ * compile time.
+ *
+ */
+struct fixed_product {
+  /**
+   * @brief Computes row i of a times column j of b
+   *
+   * @tparam A the type of the first fixed matrix
+   * @tparam B the type of the second fixed matrix
+   * @tparam K the indices along the shared dimension
+   * @return the dot product
+   */
+  template <class A, class B, size_t... K>
+  static constexpr auto dot(A const &a, B const &b, size_t i, size_t j,
+                            std::index_sequence<K...>) {
+    return (typename A::value_type() + ... + (a.get(i, K) * b.get(K, j)));
+  }
+
+  /**
+   * @brief Stores a times b into r, walking r in its flat order
+   *
+   * @tparam R the type of the result
+   * @tparam A the type of the first fixed matrix
+   * @tparam B the type of the second fixed matrix
+   * @tparam I the flat indices of the result
+   * @param r the result
+   * @param a the first operand
+   * @param b the second operand
+   */
+  template <class R, class A, class B, size_t... I>
+  static void run(R &r, A const &a, B const &b, std::index_sequence<I...>) {
+    constexpr dimension dimen = R::extent;
+    constexpr size_t inner = A::extent.col_dimen;
+    constexpr bool row_major = R::format_type::is_row_major;
+    constexpr size_t line = row_major ? dimen.col_dimen : dimen.row_dimen;
+    ((r.get(I) = dot(a, b, row_major ? I / line : I % line,
+                     row_major ? I % line : I / line,
+                     std::make_index_sequence<inner>())),
+     ...);
+  }
+};
+}  // namespace kernel
+
+/*
+@NOTICE :
+The rules of algebra walk A by rows and B by columns, so two operands with the
+same ordering {say Row and Row} would force non adjacent accesses on B while a
+Row and Column pair can be read sequencially. The packed kernel takes care of
+this: each operand is read once per panel along its own contiguous axis and the
+micro kernel only ever sees packed, sequential buffers. A | transpose(B) reads
+B row by row through the column major view without materializing the transpose.
+*/
+
+/**
+ * @brief Constructs a representation of node for the matrix product in the
+ * Abstract Syntax Tree. It stays lazy until the tree is evaluated. When it is
+ * the only product reachable through elementwise nodes, assigning the tree to
+ * a matrix runs the packed kernel once and applies those nodes to every
+ * element of the product as it is stored. Anywhere else the prepare hook
+ * materializes the product once and get reads the result. A product held in
+ * a variable may be evaluated by several threads at once, they share one
+ * materialized result. Reading it with get outside of an evaluation must not
+ * overlap an evaluation of it on another thread.
+ *
+ * @tparam E1 the left operand type
+ * @tparam E2 the right operand type
+ */
+template <typename E1, typename E2>
+class product_expr;
+
+/**
+ * @brief The number of operands of the chain of products rooted at E, 1 when
+ * E is not a product. (A | B) | C is a chain of 3 operands.
+ *
+ * @tparam E the type of the expression
+ */
+template <typename E>
+struct chain_length : std::integral_constant<size_t, 1> {};
+
+template <typename E1, typename E2>
+struct chain_length<product_expr<E1, E2>>
+    : std::integral_constant<size_t, chain_length<E1>::value +
+                                         chain_length<E2>::value> {};
+
+template <typename E1, typename E2>
+class product_expr : public expression<product_expr<E1, E2>> {
+ public:
+  /**
+   * @brief the type of the elements produced by this node
+   *
+   */
+  using value_type =
+      std::decay_t<decltype(std::declval<E1 const &>().get(0, 0) *
+                            std::declval<E2 const &>().get(0, 0))>;
+
+  /**
+   * @brief the format policy of the materialized product
+   *
+   */
+  using format_type = policy::RowMajorPolicy<value_type>;
+
+ private:
+  util::operand_t<E1> _u;
+  util::operand_t<E2> _v;
+  mutable std::mutex _lock;
+  mutable matrix<value_type> _result;
+  mutable std::atomic<bool> _ready{false};
+  mutable size_t _evaluations = 0;
+
+  /**
+   * @brief Materializes the product into _result unless it already is. The
+   * caller holds _lock.
+   *
+   */
+  void _materialize() const {
+    if (_ready.load(std::memory_order_relaxed)) return;
+    dimension dimen = get_dimension();
+    matrix<value_type> result(dimen.row_dimen, dimen.col_dimen);
+    value_type *out = dimen.count() != 0 ? &result.get(0) : nullptr;
+    size_t cols = dimen.col_dimen;
+    evaluate([=](size_t i, size_t j, value_type const &v) {
+      out[i * cols + j] = v;
+    });
+    _result = std::move(result);
+    _ready.store(true, std::memory_order_release);
+  }
+
+  /**
+   * @brief returns the materialized product, computing it on first use
+   *
+   */
+  matrix<value_type> const &_materialized() const {
+    if (!_ready.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> guard(_lock);
+      _materialize();
+    }
+    return _result;
+  }
+
+  /**
+   * @brief Returns the operands of the chain rooted at e, or e itself when it
+   * is not a product.
+   *
+   * @tparam E the type of the operand
+   * @param e the operand
+   * @return std::tuple of references to the operands
+   */
+  template <class E>
+  static auto _leaves_of(E const &e) {
+    if constexpr (chain_length<E>::value > 1)
+      return e.leaves();
+    else
+      return std::tuple<E const &>(e);
+  }
+
+ public:
+  /**
+   * @brief the materialized product is an ordinary row major matrix
+   *
+   */
+  static constexpr bool uniform_layout = true;
+
+  /**
+   * @brief the materialized product is read at (i, j). A product reading its
+   * destination is never fused, see matrix::_assign.
+   *
+   */
+  static constexpr bool pointwise = true;
+
+  /**
+   * @brief the materialized product has packets whenever value_type has one
+   *
+   */
+  static constexpr bool packet_access =
+      simd::packet_traits<value_type>::size > 1;
+
+  /**
+   * @brief this node is the fused product of the elementwise nodes above it
+   *
+   */
+  static constexpr size_t fused_products = 1;
+
+  /**
+   * @brief a product is a temporary of operator|, the nodes above, including
+   * outer products of a chain, keep a copy of it. The copy is two references
+   * and an empty matrix.
+   *
+   */
+  static constexpr bool stored_by_value = true;
+
+  /**
+   * @brief Copies the operands of other. The materialized product, if any, is
+   * not copied.
+   *
+   * @param other the product to copy
+   */
+  product_expr(product_expr const &other)
+      : _u(other._u), _v(other._v), _result(0, 0) {}
+
+  /**
+   * @brief Construct a new product expr object
+   *
+   * @param u the m x k left operand
+   * @param v the k x n right operand
+   */
+  product_expr(E1 const &u, E2 const &v) : _u(u), _v(v), _result(0, 0) {
+    if (u.get_dimension().col_dimen != v.get_dimension().row_dimen) {
+      throw std::logic_error(
+          std::string(
+              "Dot product cannot be called on matrices with dimension ") +
+          u.get_dimension().to_string() + " and " +
+          v.get_dimension().to_string());
+    }
+  }
 
-template <typename E1, typename E2>
-class mul_expr : public expression<mul_expr<E1, E2>> {
-  E1 const &_u;
-  E2 const &_v;
+  /**
+   * @brief returns the value at i in the product, row major
+   *
+   * @param i the flat index
+   * @return value_type the element of the product
+   */
+  value_type get(size_t i) const { return _materialized().get(i); }
 
- public:
   /**
-   * @brief Construct a new multiplication expr object
+   * @brief returns the value at row i and column j in the product. It is read
+   * from the product materialized for the current evaluation. Outside of an
+   * evaluation the product is materialized on first use and kept until the
+   * next evaluation of this node ends, reads in between do not see changes of
+   * the operands.
    *
-   * @param u the first operand
-   * @param v the second operand
+   * @param i the row index
+   * @param j the column index
+   * @return value_type the element of the product
    */
-  mul_expr(E1 const &u, E2 const &v) : _u(u), _v(v) {
-    util::assert_same_dimensions(u, v);
+  value_type get(size_t i, size_t j) const {
+    return _materialized().get(i, j);
   }
 
   /**
-   * @brief returns the value at i in the result
+   * @brief returns the packet of values starting at i in the product, see get
    *
-   * @param i the row index
-   * @return dtype the element of the matrix or expression
+   * @param i the index of the first element of the packet
+   * @return the packet of the product
    */
+  auto get_packet(size_t i) const { return _materialized().get_packet(i); }
 
-  auto get(size_t i) const {
-    return _u.get(i) * _v.get(util::safe_index(_u, _v, i));
+  /**
+   * @brief returns acc, the value the kernel computed for this node
+   *
+   * @tparam acc_t the type of the product
+   * @param acc the value of the product at the position being stored
+   * @return acc_t acc
+   */
+  template <class acc_t>
+  acc_t const &get_fused(size_t, size_t, acc_t const &acc) const {
+    return acc;
   }
 
   /**
-   * @brief Get the dimension of this expression object.
+   * @brief returns this node, the product the kernel computes
    *
-   * @return dimension of the expression.
+   * @return product_expr const& *this
    */
+  auto const &fused_product() const { return *this; }
 
-  auto get_dimension() const { return _u.get_dimension(); }
   /**
-   * @brief Get the format object. Please note all the formats will collapse to
-   * the format of first operand. Natrually because of our evaluation startegy.
+   * @brief Runs the packed kernel and hands every element of the product to
+   * store exactly once, see kernel::gemm::run. A chain of three or more
+   * operands is multiplied in its cheapest order, see kernel::chain
    *
-   * @return the type of the format used in this matrix
+   * @tparam Store the type of the callback
+   * @param store the callback, called as store(i, j, value)
    */
-  auto get_format() const { return _u.get_format(); }
-};
-
-/**
- * @brief Constructs a representation of node for div operation in the Abstract
- * Syntax Tree
- *
- * @tparam E1 the first operand type
- * @tparam E2 the second operand type
- */
+  template <class Store>
+  void evaluate(Store const &store) const {
+    MATRIX_PROBE("operator|");
+    MATRIX_COUNT(evaluations, 1);
+    MATRIX_COUNT(elements, get_dimension().count());
+    MATRIX_COUNT(bytes_written, get_dimension().count() * sizeof(value_type));
+    MATRIX_COUNT(bytes_read,
+                 std::apply(
+                     [](auto const &...leaf) {
+                       return (leaf.get_dimension().count() + ...) *
+                              sizeof(value_type);
+                     },
+                     leaves()));
+    if constexpr (chain_length<product_expr>::value > 2) {
+      auto operands = leaves();
+      kernel::chain<value_type>(kernel::chain<value_type>::dimensions(operands))
+          .run(operands, store);
+    } else {
+      kernel::gemm<value_type>::run(_u, _v, store);
+    }
+  }
 
-template <typename E1, typename E2>
-class div_expr : public expression<div_expr<E1, E2>> {
-  E1 const &_u;
-  E2 const &_v;
+  /**
+   * @brief Returns the operands of the chain of products rooted here, left to
+   * right, with the nested products flattened.
+   *
+   * @return std::tuple of references to the operands
+   */
+  auto leaves() const {
+    return std::tuple_cat(_leaves_of<E1>(_u), _leaves_of<E2>(_v));
+  }
 
- public:
   /**
-   * @brief Construct a new div expr object
+   * @brief Runs the prepare hooks of the operands of the chain then
+   * materializes the product, unless the caller fuses it. The first of
+   * several concurrent evaluations of this node reads the operands again,
+   * the others share its product.
    *
-   * @param u the first operand
-   * @param v the second operand
+   * @param fused true when the caller evaluates this product itself
    */
-  div_expr(E1 const &u, E2 const &v) : _u(u), _v(v) {
-    util::assert_same_dimensions(u, v);
+  void prepare(bool fused) const {
+    std::apply([](auto const &...leaf) { (util::prepare(leaf), ...); },
+               leaves());
+    std::lock_guard<std::mutex> guard(_lock);
+    if (_evaluations++ == 0) _ready.store(false, std::memory_order_relaxed);
+    if (!fused) _materialize();
   }
 
   /**
-   * @brief returns the value at i in the result
+   * @brief Drops the materialized product once the last evaluation of this
+   * node ends and runs the release hooks of the operands of the chain.
    *
-   * @param i the row index
-   * @return dtype the element of the matrix or expression
    */
+  void release() const {
+    std::apply([](auto const &...leaf) { (util::release(leaf), ...); },
+               leaves());
+    std::lock_guard<std::mutex> guard(_lock);
+    if (--_evaluations != 0) return;
+    _ready.store(false, std::memory_order_relaxed);
+    _result = matrix<value_type>(0, 0);
+  }
 
-  auto get(size_t i) const {
-    return _u.get(i) / _v.get(util::safe_index(_u, _v, i));
+  /**
+   * @brief Checks if evaluating this node reads any element in [first, last)
+   *
+   * @param first the first byte of the range
+   * @param last one past the last byte of the range
+   * @return true if either operand may read the range
+   */
+  bool references(void const *first, void const *last) const {
+    return util::references(_u, first, last) ||
+           util::references(_v, first, last);
   }
 
   /**
    * @brief Get the dimension of this expression object.
    *
-   * @return dimension of the expression.
+   * @return dimension rows of the left operand x columns of the right one
    */
-  auto get_dimension() const { return _u.get_dimension(); }
+  auto get_dimension() const {
+    return dimension(_u.get_dimension().row_dimen,
+                     _v.get_dimension().col_dimen);
+  }
+
   /**
-   * @brief Get the format object. Please note all the formats will collapse to
-   * the format of first operand. Natrually because of our evaluation startegy.
+   * @brief Get the format object.
    *
-   * @return the type of the format used in this matrix
+   * @return the format of the materialized product
    */
-  auto get_format() const { return _u.get_format(); }
+  auto get_format() const { return format_type(); }
 };
+
 /**
- * @brief Overload for Expression type. This operation returns a add_expr object
- * which can be evaluated to result it holds.
+ * @brief Overload for the matrix product of two Matrices or expressions. The
+ * product stays lazy, D = (A | B) + C * alpha runs one packed product and
+ * computes the sum while storing it into D, no temporary is created.
  *
- * @tparam E1 type of first operand
- * @tparam E2 type of second operand
- * @param u the first argument
- * @param v the second argument
- * @return add_expr<E1, E2> a proxy that represents a add operation.
+ * @tparam E1 the type of first operand
+ * @tparam E2 the type of second operand
+ * @param u the actual first argument
+ * @param v the actual second argument
+ * @return product_expr<E1, E2> a proxy that represents the product
  */
-
 template <typename E1, typename E2>
-add_expr<E1, E2> operator+(E1 const &u, E2 const &v) {
-  return add_expr<E1, E2>(u, v);
+product_expr<E1, E2> operator|(expression<E1> const &u,
+                               expression<E2> const &v) {
+  return product_expr<E1, E2>(static_cast<E1 const &>(u),
+                              static_cast<E2 const &>(v));
 }
 
 /**
- * @brief Overload for Expression type. This operation returns a sub_expr object
- * which can be evaluated to result it holds.
+ * @brief Overload for the matrix product of two fixed matrices. It is
+ * computed right away by an unrolled kernel on the calling thread and
+ * returned by value, a few multiplies are cheaper than any bookkeeping.
+ * Shapes that do not chain fail to compile, see below.
  *
- * @tparam E1 type of first operand
- * @tparam E2 type of second operand
- * @param u the first argument
- * @param v the second argument
- * @return sub_expr<E1, E2> a proxy that represents a add operation.
+ * @tparam value_t the type of the elements
+ * @tparam Rows the rows of the first operand
+ * @tparam Inner the columns of the first operand and rows of the second
+ * @tparam Cols the columns of the second operand
+ * @tparam F1 the layout of the first operand, also the layout of the result
+ * @tparam F2 the layout of the second operand
+ * @param u the first operand
+ * @param v the second operand
+ * @return fixed_matrix<value_t, Rows, Cols, F1> the product
  */
+template <typename value_t, size_t Rows, size_t Inner, size_t Cols, class F1,
+          class F2>
+fixed_matrix<value_t, Rows, Cols, F1>
+operator|(fixed_matrix<value_t, Rows, Inner, F1> const &u,
+          fixed_matrix<value_t, Inner, Cols, F2> const &v) {
+  fixed_matrix<value_t, Rows, Cols, F1> result;
+  kernel::fixed_product::run(result, u, v,
+                             std::make_index_sequence<Rows * Cols>());
+  return result;
+}
 
-template <typename E1, typename E2>
-sub_expr<E1, E2> operator-(E1 const &u, E2 const &v) {
-  return sub_expr<E1, E2>(u, v);
+/**
+ * @brief Fixed matrices whose shapes do not chain have no product
+ *
+ */
+template <typename value_t, size_t R1, size_t C1, size_t R2, size_t C2,
+          class F1, class F2, class = std::enable_if_t<C1 != R2>>
+void operator|(fixed_matrix<value_t, R1, C1, F1> const &,
+               fixed_matrix<value_t, R2, C2, F2> const &) = delete;
+
+/**
+ * @brief Computes the sum of all the elements of a matrix or expression. The
+ * expression is evaluated inside the reduction, no temporary is created.
+ *
+ * @tparam E the type of the expression
+ * @param e the expression to sum
+ * @return E::value_type the sum of the elements, zero when empty
+ */
+template <typename E>
+auto sum(expression<E> const &e) {
+  using value_t = typename E::value_type;
+  return kernel::reduce::run(
+      static_cast<E const &>(e), value_t(), [](auto const &x) { return x; },
+      kernel::fold_sum());
 }
 
 /**
- * @brief Overload for Expression type. This operation returns a mul_expr object
- * which can be evaluated to result it holds.
+ * @brief Computes the smallest element of a matrix or expression.
  *
- * @tparam E1 type of first operand
- * @tparam E2 type of second operand
- * @param u the first argument
- * @param v the second argument
- * @return mul_expr<E1, E2> a proxy that represents a add operation.
+ * @tparam E the type of the expression
+ * @param e the expression to search
+ * @return E::value_type the smallest element
  */
+template <typename E>
+auto min(expression<E> const &e) {
+  if (e.get_dimension().count() == 0)
+    throw std::logic_error("min cannot be called on an empty matrix");
+  using value_t = typename E::value_type;
+  E const &expr = static_cast<E const &>(e);
+  util::prepared<E> prepared(expr);
+  return kernel::reduce::run(
+      expr, value_t(expr.get(0, 0)), [](auto const &x) { return x; },
+      kernel::fold_min());
+}
 
-template <typename E1, typename E2>
-mul_expr<E1, E2> operator*(E1 const &u, E2 const &v) {
-  return mul_expr<E1, E2>(u, v);
+/**
+ * @brief Computes the largest element of a matrix or expression.
+ *
+ * @tparam E the type of the expression
+ * @param e the expression to search
+ * @return E::value_type the largest element
+ */
+template <typename E>
+auto max(expression<E> const &e) {
+  if (e.get_dimension().count() == 0)
+    throw std::logic_error("max cannot be called on an empty matrix");
+  using value_t = typename E::value_type;
+  E const &expr = static_cast<E const &>(e);
+  util::prepared<E> prepared(expr);
+  return kernel::reduce::run(
+      expr, value_t(expr.get(0, 0)), [](auto const &x) { return x; },
+      kernel::fold_max());
 }
 
 /**
- * @brief Overload for Expression type. This operation returns a div_expr object
- * which can be evaluated to result it holds.
+ * @brief Computes the Frobenius norm, the square root of the sum of squared
+ * magnitudes, of a matrix or expression. Integers are squared in double.
  *
- * @tparam E1 type of first operand
- * @tparam E2 type of second operand
- * @param u the first argument
- * @param v the second argument
- * @return div_expr<E1, E2> a proxy that represents a add operation.
+ * @tparam E the type of the expression
+ * @param e the expression
+ * @return the norm, a floating point value
  */
+template <typename E>
+auto norm(expression<E> const &e) {
+  using square_t = decltype(std::norm(std::declval<typename E::value_type>()));
+  auto squares = kernel::reduce::run(
+      static_cast<E const &>(e), square_t(),
+      [](auto const &x) {
+        if constexpr (util::is_scalar<std::decay_t<decltype(x)>>::value)
+          return std::norm(x);
+        else
+          return x * x;
+      },
+      kernel::fold_sum());
+  return std::sqrt(squares);
+}
+
+/**
+ * @brief Computes the sum of the diagonal of a square matrix or expression.
+ *
+ * @tparam E the type of the expression
+ * @param e the expression
+ * @return E::value_type the trace
+ */
+template <typename E>
+auto trace(expression<E> const &e) {
+  auto dimen = e.get_dimension();
+  if (dimen.row_dimen != dimen.col_dimen)
+    throw std::logic_error(
+        std::string("Trace cannot be called on a matrix with dimension ") +
+        dimen.to_string());
+  util::prepared<E> prepared(static_cast<E const &>(e));
+  using value_t = typename E::value_type;
+  value_t result = value_t();
+  for (size_t i = 0; i < dimen.row_dimen; i++) result += e.get(i, i);
+  return result;
+}
 
+/**
+ * @brief Computes the sum of the elementwise products of two matrices or
+ * expressions of the same dimension, their dot product when flattened. The
+ * products are never stored.
+ *
+ * @tparam E1 the type of the first operand
+ * @tparam E2 the type of the second operand
+ * @param u the first operand
+ * @param v the second operand
+ * @return the dot product
+ */
 template <typename E1, typename E2>
-div_expr<E1, E2> operator/(E1 const &u, E2 const &v) {
-  return div_expr<E1, E2>(u, v);
+auto dot(expression<E1> const &u, expression<E2> const &v) {
+  return sum(u * v);
 }
 
-/*
-@NOTICE :
-This dot product code cannot be very much optimized. I am forced to access the
-the elements in a matrix form to actually do the dot product. However I found
-that if two operands have different ordering {i.e Row and Column} we may in fact
-be able to sequencially access the values. However if the two have same ordering
-{say Row and Row} the rules of algebra forces us to evaluate the product by
-accessing non adjacent memory blocks. For Now I keep it same as old.
-*/
+/**
+ * @brief Computes the sum of every row as a rows x 1 vector.
+ *
+ * @tparam E the type of the expression
+ * @param e the expression to reduce
+ * @return axis_expr the sums
+ */
+template <typename E>
+auto row_sum(expression<E> const &e) {
+  return kernel::axis_reduce::sum<true>(static_cast<E const &>(e));
+}
 
 /**
- * @brief Computes the dot product of two Matrices or expression and returns the
- * result matrix immediately.
+ * @brief Computes the largest element of every row as a rows x 1 vector.
  *
- * @tparam E1 the type of first operand
- * @tparam E2 the type of second operand
- * @param u the actual first argument
- * @param v the actual second argument
- * @return lazy_matrix the result matrix.
+ * @tparam E the type of the expression
+ * @param e the expression to reduce
+ * @return axis_expr the maxima
  */
-template <typename E1, typename E2>
-auto operator|(E1 const &u, E2 const &v) {
-  if (u.get_dimension().col_dimen != v.get_dimension().row_dimen) {
-    throw std::logic_error(
-        std::string(
-            "Dot product cannot be called on matrices with dimension ") +
-        u.get_dimension().to_string() + " and " +
-        v.get_dimension().to_string());
-  }
-  matrix<decltype(u.get(0, 0))> ans(u.get_dimension().row_dimen,
-                                    v.get_dimension().col_dimen);
-#pragma omp parallel for
-  for (size_t i = 0; i < u.get_dimension().row_dimen; i++) {
-#pragma omp parallel for
-    for (size_t j = 0; j < v.get_dimension().col_dimen; j++) {
-      ans.get(i, j) = 0;
-#pragma omp parallel for
-      for (size_t k = 0; k < v.get_dimension().row_dimen; k++)
-        ans.get(i, j) += u.get(i, k) * v.get(k, j);
-    }
-  }
-  return ans;
+template <typename E>
+auto row_max(expression<E> const &e) {
+  return kernel::axis_reduce::max<true>(static_cast<E const &>(e));
+}
+
+/**
+ * @brief Computes the column index of the largest element of every row as a
+ * rows x 1 vector. Ties resolve to the first column.
+ *
+ * @tparam E the type of the expression
+ * @param e the expression to reduce
+ * @return axis_expr the indices
+ */
+template <typename E>
+auto row_argmax(expression<E> const &e) {
+  return kernel::axis_reduce::argmax<true>(static_cast<E const &>(e));
+}
+
+/**
+ * @brief Computes the mean of every row as a rows x 1 vector. Integer rows are
+ * averaged in double.
+ *
+ * @tparam E the type of the expression
+ * @param e the expression to reduce
+ * @return axis_expr the means
+ */
+template <typename E>
+auto row_mean(expression<E> const &e) {
+  return kernel::axis_reduce::mean<true>(static_cast<E const &>(e));
+}
+
+/**
+ * @brief Computes the sum of every column as a 1 x cols vector.
+ *
+ * @tparam E the type of the expression
+ * @param e the expression to reduce
+ * @return axis_expr the sums
+ */
+template <typename E>
+auto col_sum(expression<E> const &e) {
+  return kernel::axis_reduce::sum<false>(static_cast<E const &>(e));
+}
+
+/**
+ * @brief Computes the largest element of every column as a 1 x cols vector.
+ *
+ * @tparam E the type of the expression
+ * @param e the expression to reduce
+ * @return axis_expr the maxima
+ */
+template <typename E>
+auto col_max(expression<E> const &e) {
+  return kernel::axis_reduce::max<false>(static_cast<E const &>(e));
+}
+
+/**
+ * @brief Computes the row index of the largest element of every column as a
+ * 1 x cols vector. Ties resolve to the first row.
+ *
+ * @tparam E the type of the expression
+ * @param e the expression to reduce
+ * @return axis_expr the indices
+ */
+template <typename E>
+auto col_argmax(expression<E> const &e) {
+  return kernel::axis_reduce::argmax<false>(static_cast<E const &>(e));
+}
+
+/**
+ * @brief Computes the mean of every column as a 1 x cols vector. Integer
+ * columns are averaged in double.
+ *
+ * @tparam E the type of the expression
+ * @param e the expression to reduce
+ * @return axis_expr the means
+ */
+template <typename E>
+auto col_mean(expression<E> const &e) {
+  return kernel::axis_reduce::mean<false>(static_cast<E const &>(e));
 }
+/**
+ * @brief A matrix over a buffer it does not own, see storage::external
+ *
+ * @tparam value_t the type of the elements
+ * @tparam format_t the layout of the buffer
+ */
+template <typename value_t, class format_t = policy::RowMajorPolicy<value_t>>
+using external_matrix = matrix<value_t, format_t, storage::external<value_t>>;
+/**
+ * @brief A matrix whose elements start on a 64 byte boundary
+ *
+ * @tparam value_t the type of the elements
+ * @tparam format_t the layout of the elements
+ */
+template <typename value_t, class format_t = policy::RowMajorPolicy<value_t>>
+using aligned_matrix =
+    matrix<value_t, format_t, storage::aligned_vector<value_t>>;
+/**
+ * @brief A matrix whose elements live on huge pages once they span one
+ *
+ * @tparam value_t the type of the elements
+ * @tparam format_t the layout of the elements
+ */
+template <typename value_t, class format_t = policy::RowMajorPolicy<value_t>>
+using huge_page_matrix =
+    matrix<value_t, format_t, storage::huge_page_vector<value_t>>;
+/**
+ * @brief A matrix whose lines are split among the threads, each zeroing and
+ * later evaluating the same lines so that they stay on its NUMA node
+ *
+ * @tparam value_t the type of the elements
+ * @tparam format_t the layout of the elements
+ */
+template <typename value_t, class format_t = policy::RowMajorPolicy<value_t>>
+using numa_matrix =
+    matrix<value_t, format_t, storage::first_touch_vector<value_t>>;
+#if defined(MATRIX_HAS_MMAP)
+/**
+ * @brief A matrix over the payload of a memory mapped file, see io
+ *
+ * @tparam value_t the type of the elements
+ * @tparam format_t the layout of the file
+ */
+template <typename value_t, class format_t = policy::RowMajorPolicy<value_t>>
+using mapped_matrix = matrix<value_t, format_t, storage::mapped<value_t>>;
+#endif
+
 using matrix_int = matrix<int>;
 using matrix_long = matrix<long long>;
 using matrix_float = matrix<float>;
@@ -1086,5 +6346,270 @@ using matrix_complex_float = matrix<std::complex<float>>;
 using matrix_complex_double = matrix<std::complex<double>>;
 using matrix_complex_long = matrix<std::complex<long long>>;
 
+/**
+ * @brief This namespace holds the binary on disk format of a matrix. A file is
+ * an io::header, zero padding up to header::payload_offset, then the rows x
+ * cols elements in the flat order of the layout. The payload starts on a page
+ * boundary so a mapped file can be used in place.
+ *
+ */
+namespace io {
+
+/**
+ * @brief The fixed size header of a matrix file. Fields are in the byte order
+ * of the machine that wrote the file, which byte_order tells apart.
+ *
+ */
+struct header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint32_t kind;
+  std::uint32_t element_bytes;
+  std::uint32_t row_major;
+  std::uint32_t reserved;
+  std::uint64_t rows;
+  std::uint64_t cols;
+  std::uint64_t payload_offset;
+};
+
+/**
+ * @brief the alignment of the payload, one page
+ *
+ */
+constexpr std::uint64_t payload_alignment = 4096;
+
+/**
+ * @brief Encodes the type of the elements: 1 for signed integers, 2 for
+ * unsigned integers, 3 for floating point, plus 8 for std::complex of those.
+ * 0 marks a type that has no binary representation.
+ *
+ * @tparam value_t the type of the elements
+ */
+template <class value_t>
+struct dtype {
+  static constexpr std::uint32_t kind =
+      std::is_floating_point<value_t>::value ? 3
+      : std::is_integral<value_t>::value
+          ? (std::is_signed<value_t>::value ? 1 : 2)
+          : 0;
+};
+
+template <class value_t>
+struct dtype<std::complex<value_t>> {
+  static constexpr std::uint32_t kind =
+      dtype<value_t>::kind == 0 ? 0 : dtype<value_t>::kind + 8;
+};
+
+/**
+ * @brief Builds the header of a matrix of value_t laid out by format_t.
+ *
+ * @tparam value_t the type of the elements
+ * @tparam format_t the layout of the elements
+ * @param dimen the dimension of the matrix
+ * @return header the header
+ */
+template <class value_t, class format_t>
+header make_header(dimension dimen) {
+  static_assert(dtype<value_t>::kind != 0,
+                "The elements have no binary representation");
+  header h = {};
+  std::memcpy(h.magic, "TMATRIX", 8);
+  h.version = 1;
+  h.byte_order = 0x01020304;
+  h.kind = dtype<value_t>::kind;
+  h.element_bytes = sizeof(value_t);
+  h.row_major = format_t::is_row_major;
+  h.rows = dimen.row_dimen;
+  h.cols = dimen.col_dimen;
+  h.payload_offset = payload_alignment;
+  return h;
+}
+
+/**
+ * @brief Checks that a header describes a matrix of value_t.
+ *
+ * @tparam value_t the type of the elements
+ * @param h the header read from the file
+ * @param path the file, for the error message
+ */
+template <class value_t>
+void check_header(header const &h, std::string const &path) {
+  if (std::memcmp(h.magic, "TMATRIX", 8) != 0 || h.version != 1)
+    throw std::logic_error(path + " is not a matrix file");
+  if (h.byte_order != 0x01020304)
+    throw std::logic_error(path + " was written with another byte order");
+  if (h.kind != dtype<value_t>::kind || h.element_bytes != sizeof(value_t))
+    throw std::logic_error(path + " holds elements of another type");
+}
+
+/**
+ * @brief Checks that the payload a header describes fits in a file of size
+ * bytes, before anything is allocated or mapped for it. The payload must
+ * start on a multiple of payload_alignment, so mapped elements are always
+ * aligned. The element count is bounded by a division, so corrupt dimensions
+ * cannot overflow the check.
+ *
+ * @tparam value_t the type of the elements
+ * @param h the header read from the file
+ * @param size the size of the file in bytes
+ * @param path the file, for the error message
+ * @return size_t the number of elements of the payload
+ */
+template <class value_t>
+size_t check_payload(header const &h, std::uint64_t size,
+                     std::string const &path) {
+  if (h.payload_offset < sizeof(header) ||
+      h.payload_offset % payload_alignment != 0)
+    throw std::logic_error(path + " is not a matrix file");
+  if (h.payload_offset > size) throw std::logic_error(path + " is truncated");
+  std::uint64_t available = std::min<std::uint64_t>(
+      (size - h.payload_offset) / sizeof(value_t),
+      std::numeric_limits<size_t>::max() / sizeof(value_t));
+  if (h.cols != 0 && h.rows > available / h.cols)
+    throw std::logic_error(path + " is truncated");
+  return static_cast<size_t>(h.rows * h.cols);
+}
+
+/**
+ * @brief Writes a matrix to a file in the binary format.
+ *
+ * @tparam value_t the type of the elements
+ * @tparam format_t the layout of the elements
+ * @tparam storage_t the storage of the elements
+ * @param m the matrix to write
+ * @param path the file to create or overwrite
+ */
+template <class value_t, class format_t, class storage_t>
+void save(matrix<value_t, format_t, storage_t> const &m,
+          std::string const &path) {
+  header h = make_header<value_t, format_t>(m.get_dimension());
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<char const *>(&h), sizeof(h));
+  std::vector<char> padding(h.payload_offset - sizeof(h), 0);
+  out.write(padding.data(), padding.size());
+  size_t count = m.get_dimension().count();
+  std::vector<value_t> chunk(std::min<size_t>(count, 1 << 16));
+  for (size_t first = 0; first < count; first += chunk.size()) {
+    size_t n = std::min(chunk.size(), count - first);
+    for (size_t i = 0; i < n; i++) chunk[i] = m.get(first + i);
+    out.write(reinterpret_cast<char const *>(chunk.data()),
+              n * sizeof(value_t));
+  }
+  if (!out) throw std::logic_error("Cannot write the matrix to " + path);
+}
+
+/**
+ * @brief Reads a matrix file into memory. A file written in the other layout
+ * is converted while loading.
+ *
+ * @tparam value_t the type of the elements, must match the file
+ * @tparam format_t the layout of the result
+ * @param path the file to read
+ * @return matrix<value_t, format_t> the matrix
+ */
+template <class value_t, class format_t = policy::RowMajorPolicy<value_t>>
+matrix<value_t, format_t> load(std::string const &path) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  header h;
+  std::streamoff size = in.tellg();
+  if (size < 0 || !in.seekg(0) ||
+      !in.read(reinterpret_cast<char *>(&h), sizeof(h)))
+    throw std::logic_error("Cannot read a matrix from " + path);
+  check_header<value_t>(h, path);
+  std::vector<value_t> payload(
+      check_payload<value_t>(h, static_cast<std::uint64_t>(size), path));
+  in.seekg(static_cast<std::streamoff>(h.payload_offset));
+  if (!in.read(reinterpret_cast<char *>(payload.data()),
+               payload.size() * sizeof(value_t)))
+    throw std::logic_error(path + " is truncated");
+  if (bool(h.row_major) == format_t::is_row_major)
+    return matrix<value_t, format_t>(h.rows, h.cols, std::move(payload));
+  if (h.row_major)
+    return external_matrix<value_t>(payload.data(), h.rows, h.cols);
+  return external_matrix<value_t, policy::ColumnMajorPolicy<value_t>>(
+      payload.data(), h.rows, h.cols);
+}
+
+#if defined(MATRIX_HAS_MMAP)
+/**
+ * @brief Maps a matrix file in O(1), the elements are paged in from the file
+ * on first touch. Writes reach the file when writable, otherwise they stay
+ * private to the process. The file must be in the layout of format_t.
+ *
+ * @tparam value_t the type of the elements, must match the file
+ * @tparam format_t the layout of the file
+ * @param path the file to map
+ * @param writable true to write changes back to the file
+ * @return mapped_matrix<value_t, format_t> the matrix over the file
+ */
+template <class value_t, class format_t = policy::RowMajorPolicy<value_t>>
+mapped_matrix<value_t, format_t> open_mapped(std::string const &path,
+                                             bool writable = false) {
+  int fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+  if (fd < 0) throw std::logic_error("Cannot open " + path);
+  struct stat st;
+  header h;
+  bool readable = fstat(fd, &st) == 0 &&
+                  pread(fd, &h, sizeof(h), 0) == ssize_t(sizeof(h));
+  size_t length = readable ? static_cast<size_t>(st.st_size) : 0;
+  try {
+    if (!readable) throw std::logic_error("Cannot read a matrix from " + path);
+    check_header<value_t>(h, path);
+    if (bool(h.row_major) != format_t::is_row_major)
+      throw std::logic_error(path + " is stored in the other layout");
+    check_payload<value_t>(h, length, path);
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  void *base = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                    writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (base == MAP_FAILED) throw std::logic_error("Cannot map " + path);
+  size_t count = h.rows * h.cols;
+  value_t *data = reinterpret_cast<value_t *>(static_cast<char *>(base) +
+                                              h.payload_offset);
+  storage::mapped<value_t> elements(base, length, data, count, writable);
+  return mapped_matrix<value_t, format_t>(h.rows, h.cols, std::move(elements));
+}
+
+/**
+ * @brief Creates a zero filled matrix file and maps it, so that expressions
+ * can be evaluated straight into the file. Dimensions whose payload does not
+ * fit a file are rejected, bounded by a division like check_payload, before
+ * the file is touched.
+ *
+ * @tparam value_t the type of the elements
+ * @tparam format_t the layout of the file
+ * @param path the file to create or overwrite
+ * @param rows the rows in the matrix
+ * @param cols the columns in the matrix
+ * @return mapped_matrix<value_t, format_t> the matrix over the file
+ */
+template <class value_t, class format_t = policy::RowMajorPolicy<value_t>>
+mapped_matrix<value_t, format_t> create_mapped(std::string const &path,
+                                               size_t rows, size_t cols) {
+  header h = make_header<value_t, format_t>(dimension(rows, cols));
+  std::uint64_t available = std::min<std::uint64_t>(
+      (static_cast<std::uint64_t>(std::numeric_limits<off_t>::max()) -
+       h.payload_offset) /
+          sizeof(value_t),
+      std::numeric_limits<size_t>::max() / sizeof(value_t));
+  if (cols != 0 && rows > available / cols)
+    throw std::logic_error("Cannot create " + path + " with dimension " +
+                           dimension(rows, cols).to_string());
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) throw std::logic_error("Cannot create " + path);
+  size_t length = h.payload_offset + rows * cols * sizeof(value_t);
+  bool sized = ftruncate(fd, static_cast<off_t>(length)) == 0 &&
+               pwrite(fd, &h, sizeof(h), 0) == ssize_t(sizeof(h));
+  ::close(fd);
+  if (!sized) throw std::logic_error("Cannot write " + path);
+  return open_mapped<value_t, format_t>(path, true);
+}
+#endif
+}  // namespace io
+
 }  // namespace test
 #endif
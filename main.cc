@@ -17,8 +17,22 @@
 #include "benchmark.hpp"
 #include "include/matrix.hpp"
 #include "normal_matrix.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
 
 /**
  * @brief A Lambda that returns the lazy_matrix with [row,col] and filled with v
@@ -76,6 +90,31 @@ auto compute_something = [](auto &target, auto &scope) {
       scope + scope + scope;
 };
 
+/**
+ * @brief A leaf that records the threads evaluating it, every element is 1
+ *
+ */
+struct thread_probe : test::expression<thread_probe> {
+  using value_type = double;
+  using format_type = test::policy::RowMajorPolicy<double>;
+  static constexpr bool uniform_layout = true;
+  static constexpr bool pointwise = true;
+  static constexpr bool packet_access = false;
+
+  test::dimension dimen;
+  std::mutex *lock;
+  std::set<std::thread::id> *threads;
+
+  double get(size_t) const {
+    std::lock_guard<std::mutex> guard(*lock);
+    threads->insert(std::this_thread::get_id());
+    return 1.0;
+  }
+  double get(size_t i, size_t j) const { return get(i * dimen.col_dimen + j); }
+  test::dimension get_dimension() const { return dimen; }
+  format_type get_format() const { return format_type(); }
+};
+
 int main() {
   using test::benchmark;
   using test::matrix_int;
@@ -89,12 +128,27 @@ int main() {
     Matrix a2 = get_normal_matrix(1000, 1000, 0);
     Matrix b2 = get_normal_matrix(1000, 1000, 10);
 
-    auto result1 = benchmark::run("Execution with Expression template",
-                                  [&]() { compute_something(a, b); });
-    auto result2 = benchmark::run("Execution without Expression template",
-                                  [&]() { compute_something(a2, b2); });
+    // 191 operations per element, reading b and writing a once each.
+    test::benchmark_work work{1e6, 2 * 4e6, 191e6};
+    test::benchmark_options options;
+    options.samples = 5;
+    options.max_time = 1.0;
+    auto result1 = benchmark::run(
+        "Execution with Expression template",
+        [&]() { compute_something(a, b); }, options, work);
+    auto result2 = benchmark::run(
+        "Execution without Expression template",
+        [&]() { compute_something(a2, b2); }, options, work);
     result2.print_beautifully();
     result1.print_beautifully();
+    if (char const *path = std::getenv("MATRIX_BENCHMARK_JSON")) {
+      std::ofstream out(path);
+      benchmark::write_json(out, {result1, result2});
+    }
+    if (char const *path = std::getenv("MATRIX_BENCHMARK_CSV")) {
+      std::ofstream out(path);
+      benchmark::write_csv(out, {result1, result2});
+    }
     assert(a2 == a);
     assert(a == a);
   }
@@ -108,6 +162,965 @@ int main() {
     auto c = (a | b);
     assert(result == c);
   }
+  // Block 3
+  {
+    // Crosses every cache block edge of the packed product kernel.
+    size_t m = 131, k = 300, n = 270;
+    std::vector<std::vector<int>> da(m, std::vector<int>(k));
+    std::vector<std::vector<int>> db(k, std::vector<int>(n));
+    for (size_t i = 0; i < m; i++)
+      for (size_t j = 0; j < k; j++)
+        da[i][j] = static_cast<int>((i * 7 + j * 3) % 11) - 5;
+    for (size_t i = 0; i < k; i++)
+      for (size_t j = 0; j < n; j++)
+        db[i][j] = static_cast<int>((i * 5 + j * 13) % 9) - 4;
+    matrix_int a = da;
+    matrix_int b = db;
+    auto result = Matrix::dot(Matrix(da), Matrix(db));
+    auto c = (a | b);
+    assert(result == c);
+
+    // A product smaller than one tile is still split across every thread.
+    struct widest final : test::executor {
+      test::executor &inner;
+      std::atomic<size_t> tasks{0};
+      explicit widest(test::executor &e) : inner(e) {}
+      size_t concurrency() const override { return inner.concurrency(); }
+      void run(size_t count,
+               std::function<void(size_t)> const &body) override {
+        if (count > tasks) tasks = count;
+        inner.run(count, body);
+      }
+    };
+    test::work_stealing_pool pool(8);
+    widest counted(pool);
+    size_t saved = test::execution::parallel_threshold();
+    test::execution::set_parallel_threshold(0);
+    test::execution::use(&counted);
+    matrix_int split = a | b;
+    test::matrix_double ad(m, k), bd(k, n);
+    for (size_t i = 0; i < m * k; i++) ad.get(i) = da[i / k][i % k] * 0.5;
+    for (size_t i = 0; i < k * n; i++) bd.get(i) = db[i / n][i % n] * 0.25;
+    test::matrix_double cd = ad | bd;
+    test::execution::use(nullptr);
+    test::execution::set_parallel_threshold(saved);
+    assert(split == c && counted.tasks >= pool.concurrency());
+    for (size_t i = 0; i < m; i++)
+      for (size_t j = 0; j < n; j++)
+        assert(cd.get(i, j) == c.get(i, j) * 0.125);
+  }
+  // Block 4
+  {
+    // Mixed layouts are evaluated tile by tile through get(i, j).
+    using column_int = test::matrix<int, test::policy::ColumnMajorPolicy<int>>;
+    matrix_int a = get_lazy_matrix(300, 17, 3);
+    column_int b(300, 17);
+    for (size_t i = 0; i < 300; i++)
+      for (size_t j = 0; j < 17; j++) {
+        a.get(i, j) = static_cast<int>(i * 17 + j);
+        b.get(i, j) = static_cast<int>(i + j);
+      }
+    column_int c = a + b * a;
+    matrix_int d = b - a;
+    for (size_t i = 0; i < 300; i++)
+      for (size_t j = 0; j < 17; j++) {
+        assert(c.get(i, j) == a.get(i, j) + b.get(i, j) * a.get(i, j));
+        assert(d.get(i, j) == b.get(i, j) - a.get(i, j));
+      }
+    assert(a + b == b + a);
+  }
+  // Block 5
+  {
+    // Moves steal the storage, even between different dimensions.
+    matrix_int a = get_lazy_matrix(40, 30, 7);
+    int const *storage = &a.get(0);
+    matrix_int b(std::move(a));
+    assert(&b.get(0) == storage);
+    assert(a.get_dimension().count() == 0);
+    matrix_int c(2, 2);
+    c = std::move(b);
+    assert(&c.get(0) == storage);
+    assert(c.get_dimension().row_dimen == 40 && c.get(39, 29) == 7);
+    matrix_int d = c;
+    assert(d == c && &d.get(0) != storage);
+  }
+  // Block 6
+  {
+    // Adoption constructors never copy, nested containers are read once.
+    std::vector<int> flat = {1, 2, 3, 4, 5, 6};
+    int const *storage = flat.data();
+    matrix_int a(2, 3, std::move(flat));
+    assert(&a.get(0) == storage && a.get(1, 0) == 4);
+
+    int buffer[] = {1, 4, 2, 5, 3, 6};
+    test::external_matrix<int, test::policy::ColumnMajorPolicy<int>> b(buffer,
+                                                                       2, 3);
+    assert(&b.get(0) == buffer && a == b);
+
+    // Assigning an external matrix writes the buffer it was given.
+    int buffer1[] = {1, 2, 3, 4}, buffer2[] = {0, 0, 0, 0};
+    test::external_matrix<int> e1(buffer1, 2, 2), e2(buffer2, 2, 2);
+    e2 = e1;
+    e2.get(0, 0) = 42;
+    assert(buffer1[0] == 1 && buffer2[0] == 42 && buffer2[3] == 4);
+    assert(&e2.get(0) == buffer2 && &e1.get(0) == buffer1);
+    bool mismatched = false;
+    try {
+      test::external_matrix<int> e3(buffer2, 1, 4);
+      e3 = e1;
+    } catch (std::logic_error const &) {
+      mismatched = true;
+    }
+    assert(mismatched && buffer2[1] == 2);
+
+    std::deque<std::array<int, 3>> rows = {{1, 2, 3}, {4, 5, 6}};
+    matrix_int c(rows);
+    test::matrix<int, test::policy::ColumnMajorPolicy<int>> d = {{1, 2, 3},
+                                                                 {4, 5, 6}};
+    assert(c == a && d == a);
+
+    bool thrown = false;
+    try {
+      matrix_int e = {{1, 2}, {3}};
+    } catch (std::logic_error const &) {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+  // Block 7
+  {
+    // Parallel fills, the column major one crossing its block edges.
+    size_t m = 100, n = 70;
+    std::vector<std::vector<long long>> data(m, std::vector<long long>(n));
+    for (size_t i = 0; i < m; i++)
+      for (size_t j = 0; j < n; j++) data[i][j] = i * 1000 + j;
+    test::matrix_long a = data;
+    test::matrix<long long, test::policy::ColumnMajorPolicy<long long>> b =
+        data;
+    std::list<std::vector<long long>> listed(data.begin(), data.end());
+    test::matrix<long long, test::policy::ColumnMajorPolicy<long long>> c(
+        listed);
+    for (size_t i = 0; i < m; i++)
+      for (size_t j = 0; j < n; j++)
+        assert(a.get(i, j) == data[i][j] && b.get(i, j) == data[i][j] &&
+               c.get(i, j) == data[i][j]);
+  }
+  // Block 8
+  {
+    // Transposes are views, A | transpose(B) never materializes B's.
+    using test::transpose;
+    matrix_int a = {{1, 2, 3}, {4, 5, 6}};
+    matrix_int b = {{7, 8, 9}, {1, 2, 3}};
+    matrix_int at = transpose(a);
+    test::matrix<int, test::policy::ColumnMajorPolicy<int>> flipped =
+        transpose(a + b);
+    assert(at.get_dimension().row_dimen == 3 && at.get(2, 1) == 6);
+    assert(flipped.get(2, 0) == 12 && transpose(transpose(a)) == a);
+    matrix_int bt = transpose(b);
+    Matrix expected = Matrix::dot(Matrix({{1, 2, 3}, {4, 5, 6}}),
+                                  Matrix({{7, 1}, {8, 2}, {9, 3}}));
+    assert(expected == (a | transpose(b)) && expected == (a | bt));
+    assert((b | transpose(a)) == transpose(a | transpose(b)));
+
+    // A transpose of the destination goes through a temporary.
+    matrix_int s = {{1, 2, 3}, {4, 5, 6}, {7, 8, 9}};
+    matrix_int st = {{1, 4, 7}, {2, 5, 8}, {3, 6, 9}};
+    s = transpose(s);
+    assert(s == st);
+    s += transpose(s) * 2;
+    assert(s == st + transpose(st) * 2);
+    test::fixed_matrix<int, 2, 2> f = {{1, 2}, {3, 4}};
+    f = transpose(f) + f;
+    assert(f == (test::fixed_matrix<int, 2, 2>{{2, 5}, {5, 8}}));
+  }
+  // Block 9
+  {
+    // Block views read and write their parent in place.
+    using test::block;
+    matrix_int a = get_lazy_matrix(6, 5, 1);
+    matrix_int b = {{1, 2}, {3, 4}};
+    block(a, 2, 1, 2, 2) = b + b;
+    assert(a.get(2, 1) == 2 && a.get(3, 2) == 8 && a.get(1, 1) == 1);
+    test::row(a, 0) = test::row(a, 3);
+    assert(a.get(0, 1) == 6 && a.get(0, 4) == 1);
+    test::column(a, 4) += test::column(a, 0);
+    assert(a.get(5, 4) == 2);
+    matrix_int const &ca = a;
+    matrix_int c = block(ca, 2, 1, 2, 2) - b;
+    assert(c == b);
+    Matrix expected =
+        Matrix::dot(Matrix({{2, 4}, {6, 8}}), Matrix({{1, 2}, {3, 4}}));
+    assert(expected == (block(a, 2, 1, 2, 2) | b));
+
+    // Overlapping blocks of one parent go through a temporary.
+    matrix_int d = {{0, 1, 2}, {3, 4, 5}, {6, 7, 8}};
+    block(d, 1, 1, 2, 2) = block(d, 0, 0, 2, 2);
+    assert(d == (matrix_int{{0, 1, 2}, {3, 0, 1}, {6, 3, 4}}));
+    block(d, 0, 0, 2, 2) += block(d, 1, 1, 2, 2) * 10;
+    assert(d == (matrix_int{{0, 11, 2}, {33, 40, 1}, {6, 3, 4}}));
+  }
+  // Block 10
+  {
+    // Scalars are broadcast leaves fused into the same single pass.
+    test::matrix_double a(37, 3), b(37, 3), c(37, 3);
+    for (size_t i = 0; i < 37 * 3; i++) {
+      b.get(i) = i * 0.5;
+      c.get(i) = 1.0 + i;
+    }
+    a = (b + c) * 2.0 + 1.0;
+    for (size_t i = 0; i < 37 * 3; i++)
+      assert(a.get(i) == (b.get(i) + c.get(i)) * 2.0 + 1.0);
+    a = 1.0 - b / 4.0 + 3.0 / c;
+    for (size_t i = 0; i < 37 * 3; i++)
+      assert(a.get(i) == 1.0 - b.get(i) / 4.0 + 3.0 / c.get(i));
+    matrix_int d = {{1, 2}, {3, 4}};
+    d.scalar_sub(1);
+    d.scalar_div(2);
+    assert(d == (matrix_int{{0, 0}, {1, 1}}));
+    assert(d * 2 + 1 == (matrix_int{{1, 1}, {3, 3}}));
+  }
+  // Block 11
+  {
+    // Reductions evaluate the tree in place, with or without packets.
+    using column_double =
+        test::matrix<double, test::policy::ColumnMajorPolicy<double>>;
+    test::matrix_double a(61, 7), b(61, 7);
+    column_double c(61, 7);
+    for (size_t i = 0; i < 61; i++)
+      for (size_t j = 0; j < 7; j++) {
+        a.get(i, j) = static_cast<double>(i % 5) - 2.0;
+        b.get(i, j) = static_cast<double>(j);
+        c.get(i, j) = 0.5 * i;
+      }
+    double fused = 0, crossed = 0, squares = 0;
+    for (size_t i = 0; i < 61; i++)
+      for (size_t j = 0; j < 7; j++) {
+        fused += a.get(i, j) * b.get(i, j) - 1.0;
+        crossed += a.get(i, j) + c.get(i, j);
+        squares += a.get(i, j) * a.get(i, j);
+      }
+    assert(test::sum(a * b - 1.0) == fused);
+    assert(test::sum(a + c) == crossed && test::sum(c + a) == crossed);
+    assert(test::dot(a, a) == squares && test::norm(a) == std::sqrt(squares));
+    assert(test::min(a - c) == -32.0 && test::max(a * b) == 12.0);
+    assert(test::max(test::block(c, 10, 2, 3, 3)) == 6.0);
+    matrix_int d = {{1, 2, 3}, {4, 5, 6}, {7, 8, 9}};
+    assert(test::trace(d) == 15 && test::trace(test::transpose(d) * 2) == 30);
+    assert(test::norm(d) == std::sqrt(285.0) && test::sum(d) == 45);
+    test::matrix_complex_double e = {{{1, 1}, {0, 2}}, {{3, 0}, {0, 1}}};
+    assert(test::sum(e) == std::complex<double>(4, 4) && test::norm(e) == 4.0);
+
+    // Mixed operand types reduce element by element.
+    test::matrix_double f = {{0.5, 1.5, -2}, {1, 0, 0.25}, {3, -1, 2}};
+    assert(test::sum(d + f) == 50.25 && test::max(d + f) == 11.0);
+    assert(test::min(d - f) == 0.5 && test::norm(d * 0 + f) == test::norm(f));
+  }
+  // Block 12
+  {
+    // Axis reductions along and across the contiguous axis agree.
+    using column_int = test::matrix<int, test::policy::ColumnMajorPolicy<int>>;
+    size_t m = 300, n = 9;
+    matrix_int a(m, n);
+    for (size_t i = 0; i < m; i++)
+      for (size_t j = 0; j < n; j++)
+        a.get(i, j) = static_cast<int>((i * 7 + j * 5) % 13);
+    column_int b = a;
+    matrix_int rs = test::row_sum(a), cs = test::col_sum(b);
+    assert(rs == test::row_sum(b) && cs == test::col_sum(a));
+    assert(test::row_max(a) == test::row_max(b));
+    assert(test::col_argmax(a) == test::col_argmax(b));
+    for (size_t i = 0; i < m; i++) {
+      int total = 0;
+      size_t best = 0;
+      for (size_t j = 0; j < n; j++) {
+        total += a.get(i, j);
+        if (a.get(i, j) > a.get(i, best)) best = j;
+      }
+      assert(rs.get(i, 0) == total);
+      assert(test::row_argmax(b).get(i, 0) == best);
+    }
+    assert(test::sum(cs) == test::sum(a));
+    assert(test::col_mean(a).get(0, 0) == cs.get(0, 0) / double(m));
+
+    // Normalize by row and shift by the row max in one fused pass each.
+    test::matrix_double c = {{1, 3}, {2, 2}, {0, 4}};
+    test::matrix_double d = c / test::broadcast(test::row_sum(c), c);
+    assert(d == (test::matrix_double{{0.25, 0.75}, {0.5, 0.5}, {0, 1}}));
+    d = c - test::broadcast(test::row_max(c), c);
+    assert(test::max(d) == 0.0 && d.get(2, 0) == -4.0);
+    d = c - test::broadcast(test::col_mean(c), c);
+    assert(d == (test::matrix_double{{0, 0}, {1, -1}, {-1, 1}}));
+  }
+  // Block 13
+  {
+    // Products stay lazy, the elementwise tail runs in the store phase.
+    using column_int = test::matrix<int, test::policy::ColumnMajorPolicy<int>>;
+    size_t m = 70, k = 300, n = 45;
+    std::vector<std::vector<int>> da(m, std::vector<int>(k));
+    std::vector<std::vector<int>> db(k, std::vector<int>(n));
+    for (size_t i = 0; i < m; i++)
+      for (size_t j = 0; j < k; j++)
+        da[i][j] = static_cast<int>((i * 3 + j) % 7) - 3;
+    for (size_t i = 0; i < k; i++)
+      for (size_t j = 0; j < n; j++)
+        db[i][j] = static_cast<int>((i + j * 5) % 5) - 2;
+    matrix_int a = da, b = db, c = get_lazy_matrix(m, n, 4);
+    matrix_int p = a | b;
+    assert(Matrix::dot(Matrix(da), Matrix(db)) == p);
+
+    matrix_int d = (a | b) * 2 + c - 1;
+    column_int e = c - (a | b);
+    for (size_t i = 0; i < m; i++)
+      for (size_t j = 0; j < n; j++) {
+        assert(d.get(i, j) == p.get(i, j) * 2 + 3);
+        assert(e.get(i, j) == 4 - p.get(i, j));
+      }
+    d += a | b;
+    assert(d == p * 3 + 3 && (a | b) + (a | b) == p * 2);
+    assert(test::sum(a | b) == test::sum(p));
+    assert((test::transpose(b) | test::transpose(a)) == test::transpose(p));
+
+    // A product reading its own destination is materialized first.
+    matrix_int s = {{1, 2}, {3, 4}};
+    s = (s | s) + s;
+    assert(s == (matrix_int{{8, 12}, {18, 26}}));
+    assert(test::trace(s | s) == 8 * 8 + 12 * 18 + 18 * 12 + 26 * 26);
+
+    // A product held across evaluations reads its operands every time.
+    assert(test::min(a | b) == test::min(p));
+    assert(test::max(a | b) == test::max(p));
+    auto q = a | b;
+    assert(q.get(3, 4) == p.get(3, 4) && q.get(5 * n + 2) == p.get(5, 2));
+    assert(test::sum(test::transpose(q)) == test::sum(p));
+    a.get(0, 0) += 1;
+    matrix_int r = a | b;
+    assert(!(r == p) && test::sum(test::transpose(q)) == test::sum(r));
+    assert(q.get(0, 1) == r.get(0, 1) && test::max(q) == test::max(r));
+    a.get(0, 0) -= 1;
+
+    // Reads outside an evaluation share one product taken at first use.
+    auto t = a | b;
+    int first = t.get(0, 0);
+    a.get(0, 0) += 1;
+    assert(t.get(0, 0) == first && test::sum(t) == test::sum(a | b));
+    a.get(0, 0) -= 1;
+
+    // Concurrent evaluations of one held product share its result.
+    std::vector<int> sums(4);
+    std::vector<std::thread> reducers;
+    for (auto &total : sums)
+      reducers.emplace_back([&total, &q] {
+        for (int round = 0; round < 20; round++) total = test::sum(q);
+      });
+    for (auto &thread : reducers) thread.join();
+    for (int total : sums) assert(total == test::sum(p));
+
+    bool thrown = false;
+    try {
+      auto product = a | c;
+      (void)product;
+    } catch (std::logic_error const &) {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+  // Block 14
+  {
+    // Chains are multiplied in the cheapest order, whatever the parentheses.
+    auto filled = [](size_t rows, size_t cols, int salt) {
+      std::vector<std::vector<int>> data(rows, std::vector<int>(cols));
+      for (size_t i = 0; i < rows; i++)
+        for (size_t j = 0; j < cols; j++)
+          data[i][j] = static_cast<int>((i * salt + j * 3) % 5) - 2;
+      return data;
+    };
+    auto da = filled(400, 6, 1), db = filled(6, 400, 2);
+    auto dc = filled(400, 6, 3), dd = filled(6, 3, 4);
+    matrix_int a = da, b = db, c = dc, d = dd;
+    Matrix cd = Matrix::dot(Matrix(dc), Matrix(dd));
+    Matrix expected = Matrix::dot(Matrix(da), Matrix::dot(Matrix(db), cd));
+    matrix_int e = a | b | c | d;
+    assert(expected == e);
+    matrix_int f = (a | b | c | d) * 2 - e;
+    assert(f == e && test::sum(a | (b | c) | d) == test::sum(e));
+
+    // A chain bound with auto keeps its inner products alive.
+    auto g = a | b | c;
+    matrix_int h = g;
+    assert(Matrix::dot(Matrix::dot(Matrix(da), Matrix(db)), Matrix(dc)) == h);
+    assert((g | d) == e && test::sum(g) == test::sum(h));
+    test::kernel::chain<int> plan({400, 6, 400, 6, 3});
+    assert(plan.split(0, 3) == 0 && plan.split(1, 3) == 1);
+  }
+  // Block 15
+  {
+    // Aligned and huge page storage through every constructor.
+    using aligned = test::aligned_matrix<double>;
+    using huge = test::huge_page_matrix<double>;
+    auto on_line = [](double const *p) {
+      return reinterpret_cast<std::uintptr_t>(p) % 64 == 0;
+    };
+    aligned a(3, 5), b = {{1, 2}, {3, 4}};
+    aligned c = std::vector<std::vector<double>>{{1, 2}, {3, 4}};
+    aligned d = b + c, e = d;
+    test::storage::aligned_vector<double> flat(4, 2.0);
+    aligned f(2, 2, std::move(flat));
+    assert(on_line(&a.get(0)) && on_line(&b.get(0)) && on_line(&c.get(0)));
+    assert(on_line(&d.get(0)) && on_line(&e.get(0)) && on_line(&f.get(0)));
+    assert(e == b * 2.0 && f * 2.0 == b + c - b - c + 4.0);
+
+    size_t n = 512;
+    huge g(n, n), h(n, n);
+    for (size_t i = 0; i < n * n; i++) {
+      g.get(i) = static_cast<double>(i % 3);
+      h.get(i) = static_cast<double>(i % 5);
+    }
+    huge k = g + h;
+    test::matrix_double expected = test::matrix_double(g) + h;
+    assert(on_line(&g.get(0)) && on_line(&k.get(0)) && expected == k);
+    huge moved = std::move(k);
+    assert(moved == expected && k.get_dimension().count() == 0);
+  }
+  // Block 16
+  {
+    // Binary files: save and load across layouts, then map them in place.
+    using col_major = test::policy::ColumnMajorPolicy<double>;
+    std::string path = "matrix_block16.bin";
+    test::matrix_double a = {{1, 2, 3}, {4, 5, 6}};
+    test::io::save(a, path);
+    assert(test::io::load<double>(path) == a);
+    test::matrix<double, col_major> c = test::io::load<double, col_major>(path);
+    assert(c == a);
+    bool threw = false;
+    try {
+      test::io::load<int>(path);
+    } catch (std::logic_error const &) {
+      threw = true;
+    }
+    assert(threw);
+
+    {
+      test::mapped_matrix<double> m = test::io::open_mapped<double>(path);
+      assert(m == a);
+      m.get(0, 0) = 100;  // private mapping, the file is untouched
+    }
+    assert(test::io::load<double>(path) == a);
+
+    {
+      auto out = test::io::create_mapped<double>(path, 2, 3);
+      out = a * 2.0 + 1.0;
+    }
+    test::matrix_double b = a * 2.0 + 1.0;
+    assert(test::io::open_mapped<double>(path) == b);
+
+    // Headers that do not fit the file are rejected before allocating.
+    auto corrupt = [&](std::uint64_t rows, std::uint64_t cols,
+                       std::uint64_t offset) {
+      test::io::save(a, path);
+      test::io::header h;
+      std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+      file.read(reinterpret_cast<char *>(&h), sizeof(h));
+      h.rows = rows;
+      h.cols = cols;
+      h.payload_offset = offset;
+      file.seekp(0);
+      file.write(reinterpret_cast<char const *>(&h), sizeof(h));
+      file.close();
+      size_t rejected = 0;
+      try {
+        test::io::load<double>(path);
+      } catch (std::logic_error const &) {
+        rejected++;
+      }
+      try {
+        test::io::open_mapped<double>(path);
+      } catch (std::logic_error const &) {
+        rejected++;
+      }
+      return rejected;
+    };
+    std::uint64_t offset = test::io::payload_alignment;
+    assert(corrupt(3, 3, offset) == 2);
+    assert(corrupt(std::uint64_t(1) << 62, 4, offset) == 2);
+    assert(corrupt(std::uint64_t(1) << 33, std::uint64_t(1) << 33, offset) ==
+           2);
+    assert(corrupt(2, 3, std::uint64_t(-1)) == 2);
+    assert(corrupt(2, 3, 8) == 2);
+    assert(corrupt(2, 3, 60) == 2);
+    assert(corrupt(2, 3, offset) == 0);
+
+    // Dimensions too large for a file leave the existing file untouched.
+    size_t huge_rows = std::numeric_limits<size_t>::max() / 4;
+    bool refused = false;
+    try {
+      test::io::create_mapped<double>(path, huge_rows, 8);
+    } catch (std::logic_error const &) {
+      refused = true;
+    }
+    assert(refused && test::io::load<double>(path) == a);
+    std::remove(path.c_str());
+  }
+  // Block 17
+  {
+    // Outputs larger than a chunk are evaluated a few lines at a time.
+    using col_major = test::policy::ColumnMajorPolicy<double>;
+    using test::transpose;
+    size_t rows = 301, cols = 67;
+    test::matrix_double a(rows, cols), b(rows, cols);
+    for (size_t i = 0; i < rows * cols; i++) {
+      a.get(i) = static_cast<double>(i % 11);
+      b.get(i) = static_cast<double>(i % 7);
+    }
+    test::matrix<double, col_major> c = a * 3.0;
+    test::matrix_double whole = a * 2.0 + b - c, acc = a;
+    acc += transpose(transpose(b)) * c;
+    test::matrix<double, col_major> whole_cols = a + c;
+
+    size_t saved = test::streaming::chunk_bytes();
+    test::streaming::set_chunk_bytes(4096);
+    test::matrix_double part = a * 2.0 + b - c, part_acc = a;
+    part_acc += transpose(transpose(b)) * c;
+    test::matrix<double, col_major> part_cols = a + c;
+    assert(part == whole && part_acc == acc && part_cols == whole_cols);
+
+    // Mapped files stream through shared mappings in both directions.
+    std::string path = "matrix_block17.bin", copy = "matrix_block17c.bin";
+    {
+      auto out = test::io::create_mapped<double>(path, rows, cols);
+      out = a * 2.0 + b - c;
+    }
+    {
+      auto in = test::io::open_mapped<double>(path, true);
+      auto out = test::io::create_mapped<double>(copy, rows, cols);
+      out = in + 1.0;
+      assert(in == whole && out == whole + 1.0);
+    }
+    test::streaming::set_chunk_bytes(saved);
+    assert(test::io::load<double>(copy) == whole + 1.0);
+    std::remove(path.c_str());
+    std::remove(copy.c_str());
+  }
+  // Block 18
+  {
+    // Fixed size matrices live inline and interoperate with expressions.
+    using m3 = test::fixed_matrix<double, 3, 3>;
+    using c3 = test::fixed_matrix<double, 3, 3,
+                                  test::policy::ColumnMajorPolicy<double>>;
+    using test::transpose;
+    static_assert(sizeof(m3) == 9 * sizeof(double), "no extra state");
+    static_assert(m3::extent.count() == 9, "constexpr dimension");
+    m3 r = {{0, -1, 0}, {1, 0, 0}, {0, 0, 1}};
+    c3 s = {{2, 0, 0}, {0, 3, 0}, {1, 0, 4}};
+    test::matrix_double dr = r, ds = s;
+    m3 rs = r | s;
+    test::matrix_double expected = dr | ds;
+    assert(rs == expected && (r | r | r | r) == (dr | dr | dr | dr));
+    m3 mixed = r + s * 2.0 - transpose(r);
+    assert(mixed == dr + ds * 2.0 - transpose(dr));
+    test::matrix_double wide = (r | s) + ds;
+    assert(wide == expected + ds && test::trace(rs) == test::trace(expected));
+    mixed += r;
+    mixed -= r;
+    assert(mixed == dr + ds * 2.0 - transpose(dr));
+
+    test::fixed_matrix<int, 2, 3> a = {{1, 2, 3}, {4, 5, 6}};
+    test::fixed_matrix<int, 3, 1> v = {{1}, {0}, {-1}};
+    test::fixed_matrix<int, 2, 1> av = a | v;
+    assert(av.get(0, 0) == -2 && av.get(1, 0) == -2);
+    assert(test::sum(a) == 21 && (a | transpose(a)) == (test::matrix_int(a) |
+                                                        transpose(a)));
+    bool threw = false;
+    try {
+      m3 wrong = test::matrix_double(2, 3);
+      (void)wrong;
+    } catch (std::logic_error const &) {
+      threw = true;
+    }
+    assert(threw);
+  }
+  // Block 19
+  {
+    // Every loop gives the same result serial and parallel.
+    using col_major = test::policy::ColumnMajorPolicy<double>;
+    using test::transpose;
+    size_t saved = test::execution::parallel_threshold();
+    test::matrix_double a(97, 131), b(131, 97);
+    for (size_t i = 0; i < a.get_dimension().count(); i++) {
+      a.get(i) = static_cast<double>(i % 13);
+      b.get(i) = static_cast<double>(i % 5);
+    }
+    auto evaluate = [&] {
+      test::matrix<double, col_major> c = a * 2.0 + transpose(b);
+      c += a;
+      test::matrix_double p = (a | b) - 1.0;
+      auto rows = test::row_sum(c);
+      auto cols = test::col_max(a + c);
+      return std::make_tuple(c, p, test::sum(a * a), test::trace(p),
+                             rows.get(3), cols.get(7));
+    };
+    test::execution::set_parallel_threshold(0);
+    auto parallel = evaluate();
+    test::execution::set_parallel_threshold(static_cast<size_t>(-1));
+    auto serial = evaluate();
+    assert(std::get<0>(parallel) == std::get<0>(serial));
+    assert(std::get<1>(parallel) == std::get<1>(serial));
+    assert(std::get<2>(parallel) == std::get<2>(serial));
+    assert(std::get<3>(parallel) == std::get<3>(serial));
+    assert(std::get<4>(parallel) == std::get<4>(serial));
+    assert(std::get<5>(parallel) == std::get<5>(serial));
+
+    // The threshold may change while other threads run loops.
+    std::atomic<bool> done{false};
+    std::thread toggler([&] {
+      for (size_t n = 0; !done.load(); n++)
+        test::execution::set_parallel_threshold(n % 2 ? 0 : size_t(-1));
+    });
+    auto mixed = evaluate();
+    done = true;
+    toggler.join();
+    assert(std::get<0>(mixed) == std::get<0>(serial));
+    assert(std::get<1>(mixed) == std::get<1>(serial));
+
+    // Thresholds survive a round trip through a calibration file.
+    std::string path = "matrix_block19.cal";
+    test::execution::set_parallel_threshold(12345);
+    size_t loaded = 0;
+    assert(test::execution::save(path));
+    assert(test::execution::load(path, loaded) && loaded == 12345);
+    assert(!test::execution::load("matrix_block19.missing", loaded));
+    assert(test::execution::calibrate() > 0);
+    test::execution::set_parallel_threshold(saved);
+    std::remove(path.c_str());
+  }
+  // Block 20
+  {
+    // The work stealing pool runs nested and concurrent calls and rethrows.
+    test::work_stealing_pool pool(4);
+    std::atomic<size_t> total{0};
+    pool.run(64, [&](size_t t) {
+      pool.run(t % 5, [&](size_t u) { total += u + 1; });
+    });
+    size_t expected = 0;
+    for (size_t t = 0; t < 64; t++) expected += (t % 5) * (t % 5 + 1) / 2;
+    assert(total == expected && pool.concurrency() == 4);
+    bool threw = false;
+    try {
+      pool.run(16, [](size_t t) {
+        if (t == 7) throw std::logic_error("task");
+      });
+    } catch (std::logic_error const &) {
+      threw = true;
+    }
+    assert(threw);
+
+    // Loops and products go through an injected executor.
+    struct counting final : test::executor {
+      test::executor &inner;
+      std::atomic<size_t> calls{0};
+      explicit counting(test::executor &e) : inner(e) {}
+      size_t concurrency() const override { return inner.concurrency(); }
+      void run(size_t tasks,
+               std::function<void(size_t)> const &body) override {
+        calls++;
+        inner.run(tasks, body);
+      }
+    } injected(pool);
+    size_t saved = test::execution::parallel_threshold();
+    test::execution::set_parallel_threshold(0);
+    test::execution::use(&injected);
+    test::matrix_double a(120, 90), b(90, 70);
+    for (size_t i = 0; i < a.get_dimension().count(); i++)
+      a.get(i) = static_cast<double>(i % 17);
+    for (size_t i = 0; i < b.get_dimension().count(); i++)
+      b.get(i) = static_cast<double>(i % 3);
+    test::matrix_double p = (a | b) * 2.0, q = a + a;
+    double total_sum = test::sum(q);
+    std::vector<std::thread> callers;
+    std::atomic<bool> agree{true};
+    for (int c = 0; c < 3; c++)
+      callers.emplace_back([&] {
+        test::matrix_double mine = (a | b) * 2.0;
+        if (!(mine == p) || test::sum(a + a) != total_sum) agree = false;
+      });
+    for (auto &t : callers) t.join();
+    assert(injected.calls > 0 && agree);
+    test::execution::use(nullptr);
+    test::execution::set_parallel_threshold(static_cast<size_t>(-1));
+    assert(p == (a | b) * 2.0 && test::sum(q) == total_sum);
+    test::execution::set_parallel_threshold(saved);
+  }
+
+  // Block 21
+  {
+    // Pinned tasks run on the same thread in every call.
+    test::work_stealing_pool pool(4);
+    std::vector<std::thread::id> first(12), second(12);
+    pool.run_pinned(12,
+                    [&](size_t t) { first[t] = std::this_thread::get_id(); });
+    pool.run_pinned(12,
+                    [&](size_t t) { second[t] = std::this_thread::get_id(); });
+    assert(first == second && first[0] != first[1] && first[0] == first[4]);
+    assert(first[3] == std::this_thread::get_id());
+
+    // Pinned calls nested in the tasks of other calls run on their worker.
+    std::atomic<size_t> nested{0};
+    pool.run(6, [&](size_t) {
+      pool.run_pinned(8, [&](size_t) {
+        pool.run_pinned(3, [&](size_t) { nested.fetch_add(1); });
+      });
+    });
+    pool.run_pinned(4, [&](size_t) {
+      pool.run(5, [&](size_t) { nested.fetch_add(1); });
+    });
+    assert(nested.load() == 6 * 8 * 3 + 4 * 5);
+
+    // A first touch buffer is not resident before it is written.
+#if defined(__linux__)
+    {
+      test::storage::first_touch_allocator<double> alloc;
+      size_t n = size_t(1) << 20, page = sysconf(_SC_PAGESIZE);
+      double *buffer = alloc.allocate(n);
+      std::vector<unsigned char> resident(n * sizeof(double) / page + 1);
+      assert(mincore(buffer, n * sizeof(double), resident.data()) == 0);
+      assert(std::count(resident.begin(), resident.end(), 1) == 0);
+      buffer[0] = 1.0;
+      assert(test::storage::numa_node(buffer) >= -1);
+      alloc.deallocate(buffer, n);
+    }
+#endif
+
+    // Partitioned evaluation matches the plain matrix, serial and parallel.
+    static_assert(test::storage::first_touch<
+                  test::storage::first_touch_vector<double>>::value);
+    static_assert(!test::storage::first_touch<std::vector<double>>::value);
+    size_t saved = test::execution::parallel_threshold();
+    for (size_t threshold : {size_t(0), static_cast<size_t>(-1)}) {
+      test::execution::set_parallel_threshold(threshold);
+      test::execution::use(&pool);
+      test::matrix_double a(301, 77), b(301, 77);
+      for (size_t i = 0; i < a.get_dimension().count(); i++) {
+        a.get(i) = static_cast<double>(i % 23);
+        b.get(i) = static_cast<double>(i % 5);
+      }
+      test::numa_matrix<double> n(301, 77);
+      assert(test::sum(n) == 0.0);
+      n = a + b * 2.0;
+      n += a;
+      assert(n == a + a + b * 2.0);
+      test::numa_matrix<double, test::policy::ColumnMajorPolicy<double>> c =
+          test::transpose(a);
+      c -= test::transpose(b);
+      assert(c == test::transpose(a - b));
+      size_t saved_bytes = test::streaming::chunk_bytes();
+      test::streaming::set_chunk_bytes(4096);
+      test::numa_matrix<double> s = a * b;
+      assert(s == a * b);
+
+      // Chunking is skipped, all partitions are written in one pinned call.
+      struct pinned_counter final : test::executor {
+        test::executor &inner;
+        std::atomic<size_t> calls{0};
+        explicit pinned_counter(test::executor &e) : inner(e) {}
+        size_t concurrency() const override { return inner.concurrency(); }
+        void run(size_t tasks,
+                 std::function<void(size_t)> const &body) override {
+          inner.run(tasks, body);
+        }
+        void run_pinned(size_t tasks,
+                        std::function<void(size_t)> const &body) override {
+          calls++;
+          inner.run_pinned(tasks, body);
+        }
+      } pinned(pool);
+      test::execution::use(&pinned);
+      std::mutex lock;
+      std::set<std::thread::id> writers;
+      s = thread_probe{{}, s.get_dimension(), &lock, &writers};
+      test::execution::use(&pool);
+      bool parallel = threshold == 0;
+      assert(writers.size() == (parallel ? pool.concurrency() : 1));
+      assert(pinned.calls == (parallel ? 1 : 0));
+      assert(test::sum(s) == 301.0 * 77.0);
+      test::streaming::set_chunk_bytes(saved_bytes);
+      test::execution::use(nullptr);
+    }
+    test::execution::set_parallel_threshold(saved);
+  }
+
+  // Block 22
+  {
+    // Benchmark statistics and throughput.
+    test::benchmark_result r("stats", {40, 10, 30, 20}, 8, {100, 800, 200});
+    assert(r.execution_time == 25 && r.min == 10 && r.p95 == 40);
+    assert(r.mean == 25 && std::abs(r.stddev - std::sqrt(500.0 / 3)) < 1e-9);
+    assert(r.elements_per_second() == 4e9 && r.gigabytes_per_second() == 32);
+    assert(r.gflops() == 8);
+    test::benchmark_options quick;
+    quick.warmup_time = 0;
+    quick.min_time = 1e-4;
+    quick.samples = 3;
+    size_t calls = 0;
+    auto timed = benchmark::run(
+        "count", [&] { test::do_not_optimize(++calls); }, quick);
+    assert(timed.samples.size() == 3 && timed.iterations > 1);
+    assert(timed.execution_time > 0 && timed.p95 >= timed.execution_time);
+    std::ostringstream json, csv;
+    benchmark::write_json(json, {r});
+    benchmark::write_csv(csv, {r});
+    assert(json.str().find("\"median_ns\": 25,") != std::string::npos);
+    assert(csv.str().find("\n\"stats\",25,25,") != std::string::npos);
+  }
+
+  // Block 23
+  {
+    // Counters are read when the system allows it and left out otherwise.
+    test::perf_counters counters;
+    counters.start();
+    std::vector<char> fresh(size_t(16) << 20, 1);
+    test::do_not_optimize(fresh[fresh.size() / 2]);
+    auto events = counters.stop(1);
+    using event = test::benchmark_counters;
+    for (size_t e = 0; e < event::events; e++)
+      assert(events.available(static_cast<event::event>(e)) ||
+             !counters.error().empty());
+    if (events.available(event::page_faults))
+      assert(events[event::page_faults] > 0);
+    assert(events.ipc() < 0 || events.available(event::cycles));
+
+    test::benchmark_options quick;
+    quick.warmup_time = 0;
+    quick.min_time = 1e-4;
+    quick.samples = 3;
+    quick.counters = true;
+    std::vector<double> v(4096, 1.0);
+    auto r = benchmark::run(
+        "counted",
+        [&] {
+          for (auto &x : v) x = x * 0.5 + 1.0;
+          test::clobber_memory();
+        },
+        quick, {4096, 2 * 4096 * sizeof(double), 2 * 4096});
+    assert(r.counters.available(event::instructions) ==
+           (r.per_element(event::instructions) >= 0));
+    std::ostringstream json, csv;
+    benchmark::write_json(json, {r});
+    benchmark::write_csv(csv, {r});
+    assert((json.str().find("\"instructions\"") != std::string::npos) ==
+           r.counters.available(event::instructions));
+    std::string header = test::benchmark_result::csv_header();
+    std::string row = csv.str().substr(header.size());
+    assert(std::count(row.begin(), row.end(), ',') ==
+           std::count(header.begin(), header.end(), ','));
+  }
+
+  // Block 24
+  {
+    // Results read back from JSON compare against new runs.
+    test::benchmark_result steady("a \"quoted\" label", {100, 101, 99}, 4);
+    test::benchmark_result noisy("noisy", {100, 160, 40}, 4);
+    test::benchmark_result gone("gone", {5}, 1);
+    steady.counters.values[test::benchmark_counters::page_faults] = 2;
+    std::stringstream json;
+    benchmark::write_json(json, {steady, noisy, gone});
+    auto baseline = benchmark::read_json(json);
+    assert(baseline.size() == 3 && baseline[0].label == steady.label);
+    assert(baseline[0].execution_time == 100 && baseline[1].stddev == 60);
+    assert(baseline[0].iterations == 4 && baseline[0].counters.values[6] == 2);
+
+    test::benchmark_result slower(steady.label, {130, 131, 129}, 4);
+    test::benchmark_result faster(steady.label, {70, 71, 69}, 4);
+    test::benchmark_result within(steady.label, {105, 106, 104}, 4);
+    test::benchmark_result jittery("noisy", {130, 190, 70}, 4);
+    test::benchmark_result added("added", {1}, 1);
+    using change = test::benchmark_change;
+    auto verdicts = [&](test::benchmark_result const &r) {
+      auto changes = benchmark::compare(baseline, {r, jittery, added}, 0.1);
+      assert(changes.size() == 4 && changes[1].result == change::same);
+      assert(changes[2].result == change::added);
+      assert(changes[3].result == change::removed);
+      return changes[0];
+    };
+    assert(verdicts(slower).result == change::slower);
+    assert(std::abs(verdicts(slower).change() - 0.3) < 1e-9);
+    assert(verdicts(faster).result == change::faster);
+    assert(verdicts(within).result == change::same);
+    std::ostringstream table;
+    benchmark::write_changes(table, benchmark::compare(baseline, {slower}, 0));
+    assert(table.str().find("+30.0%  SLOWER") != std::string::npos);
+    bool threw = false;
+    try {
+      std::istringstream broken("[{\"label\": \"x\", \"median_ns\": }]");
+      benchmark::read_json(broken);
+    } catch (std::logic_error const &) {
+      threw = true;
+    }
+    assert(threw);
+  }
+
+  // Block 25
+#if defined(MATRIX_INSTRUMENT)
+  {
+    // Operations are counted per call site, and only when compiled in.
+    using column_major =
+        test::matrix<double, test::policy::ColumnMajorPolicy<double>>;
+    auto &registry = test::instrument::registry::global();
+    registry.reset();
+    std::string site;
+    {
+      MATRIX_INSTRUMENT_SCOPE("block 25");
+      site = test::instrument::scope::current();
+      test::matrix<double> a(64, 32), b(64, 32);
+      test::matrix<double> c = a + b;
+      c += a;
+      column_major d = c;
+      d = a - b;
+      test::matrix<double> e = a | test::transpose(b);
+      test::matrix<double> empty(0, 0);
+    }
+    assert(site.find("block 25 (") == 0);
+    assert(test::instrument::scope::current() == "(unscoped)");
+    auto constructed = registry.find(site, "constructor");
+    assert(constructed.calls == 5 && constructed.allocations == 5);
+    assert(constructed.evaluations == 3);
+    auto added = registry.find(site, "operator+=");
+    assert(added.calls == 1 && added.elements == 64 * 32);
+    assert(added.bytes_read == 2 * 64 * 32 * sizeof(double));
+    assert(added.bytes_written == 64 * 32 * sizeof(double));
+    assert(added.layout_conversions == 0 && added.allocations == 0);
+    auto assigned = registry.find(site, "operator=");
+    assert(assigned.calls == 1 && assigned.layout_conversions == 1);
+    auto product = registry.find("", "operator|");
+    assert(product.calls == 1 && product.elements == 64 * 64);
+    assert(product.bytes_read == 2 * 64 * 32 * sizeof(double));
+    assert(registry.find("", "operator*=").calls == 0);
+    std::ostringstream report;
+    registry.dump(report);
+    assert(report.str().find(site + " operator+=: 1 calls") !=
+           std::string::npos);
+  }
+#endif
+
+  // Block 26
+  {
+    // Promoting operands are evaluated element by element, not by packet.
+    test::matrix<short> a(37, 19), b(37, 19);
+    test::matrix<unsigned char> c(37, 19), d(37, 19);
+    for (size_t i = 0; i < 37; i++)
+      for (size_t j = 0; j < 19; j++) {
+        a.get(i, j) = static_cast<short>(30000 - i);
+        b.get(i, j) = static_cast<short>(j * 1000);
+        c.get(i, j) = static_cast<unsigned char>(200 + j);
+        d.get(i, j) = static_cast<unsigned char>(i * 7);
+      }
+    matrix_int e = a + b;
+    matrix_int f = c * d - a;
+    for (size_t i = 0; i < 37; i++)
+      for (size_t j = 0; j < 19; j++) {
+        assert(e.get(i, j) == int(a.get(i, j)) + int(b.get(i, j)));
+        assert(f.get(i, j) ==
+               int(c.get(i, j)) * int(d.get(i, j)) - int(a.get(i, j)));
+      }
+  }
 
   return 0;
 }